@@ -0,0 +1,108 @@
+#ifndef VITACONTROL_H
+#define VITACONTROL_H
+
+// Syscalls exported by the VitaControl kernel plugin, for use by companion apps like the mapper.
+// Link against libVitaControl_stub_weak.a so apps still start when the plugin isn't loaded.
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Raw input report logging modes
+#define VITACONTROL_RAWLOG_OFF    0
+#define VITACONTROL_RAWLOG_TEXT   1 // Delta lines in ux0:data/vitacontrol_mapper_raw.txt (read by the mapper)
+#define VITACONTROL_RAWLOG_BINARY 2 // Compact deltas in ux0:data/vitacontrol_raw.bin (see vitacontrol_rawlog.h)
+
+// Set the raw input report logging mode (off by default)
+int vitacontrolSetRawLog(int mode);
+
+// Bytes of each report kept in capture records
+#define VITACONTROL_CAPTURE_REPORT_SIZE 128
+
+// A raw input report captured by the plugin
+typedef struct VitacontrolCaptureRecord
+{
+    uint64_t time;   // System time the report arrived, in microseconds
+    uint8_t slot;    // Controller slot (0-3)
+    uint8_t length;  // Number of valid bytes in data
+    uint8_t reserved[6];
+    uint8_t data[VITACONTROL_CAPTURE_REPORT_SIZE];
+} VitacontrolCaptureRecord;
+
+// Start or stop capturing raw input reports into the plugin's in-memory ring (off by default)
+// Starting a capture discards anything left over from a previous one
+int vitacontrolSetCapture(int enabled);
+
+// Copy up to count captured records into records, waiting up to timeout microseconds for one to arrive
+// if none are pending (0 returns immediately). Returns the number of records copied, or a negative error.
+// Only one thread should read at a time; records that arrive while the ring is full are dropped.
+int vitacontrolReadCapture(VitacontrolCaptureRecord *records, int count, unsigned int timeout);
+
+// Histogram buckets in the statistics, and the time each one covers (the last one also counts anything longer)
+#define VITACONTROL_STATS_BUCKETS   64
+#define VITACONTROL_STATS_BUCKET_US 250
+
+// Hooked function groups counted in the statistics
+#define VITACONTROL_HOOK_CTRL   0
+#define VITACONTROL_HOOK_TOUCH  1
+#define VITACONTROL_HOOK_MOTION 2
+#define VITACONTROL_HOOK_COUNT  3
+
+// Performance counters for a controller slot; counters reset when a controller connects
+typedef struct VitacontrolSlotStats
+{
+    uint32_t connected;
+    uint32_t reports;         // Input reports received
+    uint32_t droppedReports;  // Input reports rejected by the driver (bad CRC)
+    uint32_t lateReports;     // Input reports that arrived over twice the average interval after the previous one
+    uint64_t lastReportTime;  // System time of the last input report, in microseconds
+    uint32_t averageInterval; // Moving average of the time between reports, in 1/16 microseconds
+    uint32_t jitter;          // Moving average of the change in time between reports, in 1/16 microseconds
+    uint32_t decodeTime;      // Total time spent decoding reports, in microseconds
+    uint32_t decodeTimeMax;   // Longest time spent decoding a report, in microseconds
+    uint32_t firstInputTime;  // Time from the connection being accepted to the first decoded input, in microseconds
+                              // (0 until then)
+    uint32_t cached;          // Whether the controller was set up from what was cached on an earlier connection
+    uint32_t intervals[VITACONTROL_STATS_BUCKETS]; // Histogram of the time between reports
+    uint32_t latencies[VITACONTROL_STATS_BUCKETS]; // Histogram of the time from a report arriving to the first read
+} VitacontrolSlotStats;
+
+// Performance counters for the whole plugin; counters only ever increase, so compare snapshots for rates
+typedef struct VitacontrolStats
+{
+    uint64_t time;                               // System time the snapshot was taken, in microseconds
+    uint32_t hookCalls[VITACONTROL_HOOK_COUNT];  // Calls to hooked functions that patched in controller data
+    uint32_t rawLogDropped;                      // Reports the raw log couldn't keep up with
+    uint32_t captureDropped;                     // Reports the capture reader couldn't keep up with
+    VitacontrolSlotStats slots[4];
+} VitacontrolStats;
+
+// Copy a snapshot of the performance counters
+int vitacontrolGetStats(VitacontrolStats *stats);
+
+// Log levels; messages above a category's level are skipped
+#define VITACONTROL_LOG_NONE  0
+#define VITACONTROL_LOG_ERROR 1
+#define VITACONTROL_LOG_WARN  2
+#define VITACONTROL_LOG_INFO  3
+#define VITACONTROL_LOG_DEBUG 4
+
+// Log categories
+#define VITACONTROL_LOG_CORE   0
+#define VITACONTROL_LOG_BT     1
+#define VITACONTROL_LOG_DRIVER 2
+#define VITACONTROL_LOG_REPORT 3
+#define VITACONTROL_LOG_RAWLOG 4
+#define VITACONTROL_LOG_CATEGORY_COUNT 5
+#define VITACONTROL_LOG_ALL -1
+
+// Set the runtime log level for a category, or for all of them with VITACONTROL_LOG_ALL
+// Levels above the plugin's compile-time maximum (LOG_MAX_LEVEL) have no effect
+int vitacontrolSetLogLevel(int category, int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VITACONTROL_H
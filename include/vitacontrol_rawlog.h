@@ -0,0 +1,274 @@
+#ifndef VITACONTROL_RAWLOG_H
+#define VITACONTROL_RAWLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary raw log format, shared by the kernel plugin (writer) and host tools (readers).
+//
+// The file starts with an 8-byte header: "VCRL", the format version, and 3 reserved bytes. Each record is:
+//   tag     1 byte: slot in bits 0-1, keyframe flag in bit 2, record type in bits 4-7
+//   time    varint: microseconds since the previous record (since 0 for the first one)
+//   length  varint: report length, only present in keyframes (deltas keep the slot's last length)
+//   runs    varint: number of runs that follow (0 for a report that didn't change), then for each run:
+//             varint skip (unchanged bytes since the end of the previous run), varint count, and count bytes
+//             XORed with the slot's previous report (an all-zero report for keyframes)
+// Varints are little-endian base 128, with the top bit of each byte set if more bytes follow.
+//
+// Device records (type 1) say which controller a slot's reports come from, and are written before the first report
+// from each newly connected device. After the tag and time, they hold the VID and PID as varints.
+//
+// Dropped records (type 2, version 2 and up) say how many reports were lost since the previous one because the plugin's
+// queue was full, as a varint after the tag and time. Their slot bits are unused.
+
+#define VCRL_MAGIC       "VCRL"
+#define VCRL_VERSION     2
+#define VCRL_HEADER_SIZE 8
+
+#define VCRL_MAX_SLOTS  4
+#define VCRL_MAX_REPORT 128
+
+// Upper bound for the size of one encoded record
+#define VCRL_MAX_RECORD (1 + 10 + 2 + 2 + 2 + VCRL_MAX_REPORT)
+
+#define VCRL_TAG_SLOT     0x03
+#define VCRL_TAG_KEYFRAME 0x04
+#define VCRL_TAG_TYPE     0xF0
+
+#define VCRL_TYPE_REPORT  0x00
+#define VCRL_TYPE_DEVICE  0x01
+#define VCRL_TYPE_DROPPED 0x02
+
+typedef struct VcrlSlot
+{
+    uint8_t data[VCRL_MAX_REPORT];
+    uint32_t length;
+    int valid;
+} VcrlSlot;
+
+static inline uint8_t *vcrlPutVarint(uint8_t *p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static inline const uint8_t *vcrlGetVarint(const uint8_t *p, const uint8_t *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline uint8_t *vcrlPutHeader(uint8_t *p)
+{
+    p[0] = 'V'; p[1] = 'C'; p[2] = 'R'; p[3] = 'L';
+    p[4] = VCRL_VERSION;
+    p[5] = p[6] = p[7] = 0;
+    return p + VCRL_HEADER_SIZE;
+}
+
+static inline int vcrlCheckHeader(const uint8_t *p, size_t size)
+{
+    // Each version only adds record types, so older logs can still be read
+    return size >= VCRL_HEADER_SIZE && p[0] == 'V' && p[1] == 'C' && p[2] == 'R' && p[3] == 'L' &&
+        p[4] >= 1 && p[4] <= VCRL_VERSION;
+}
+
+// Encode a report as a delta against the slot's previous one, and make it the new previous report.
+// Returns the end of the record. Unchanged reports are still written, with no runs, so the log keeps the report rate.
+static inline uint8_t *vcrlEncodeReport(uint8_t *p, int slot, uint64_t timeDelta, VcrlSlot *state,
+    const uint8_t *data, uint32_t length)
+{
+    uint32_t i, runs = 0, deltaSize = 0;
+
+    if (length > VCRL_MAX_REPORT)
+        length = VCRL_MAX_REPORT;
+
+    // Count the runs of changed bytes and the space they'd take, to pick between a delta and a keyframe
+    int keyframe = !state->valid || state->length != length;
+    if (!keyframe)
+    {
+        uint32_t runEnd = 0;
+        for (i = 0; i < length; i++)
+        {
+            if (data[i] == state->data[i]) continue;
+            uint32_t start = i;
+            while (i < length && data[i] != state->data[i]) i++;
+            runs++;
+            deltaSize += (start - runEnd >= 0x80) + (i - start >= 0x80) + 2 + (i - start);
+            runEnd = i;
+        }
+        keyframe = deltaSize > length + 4;
+    }
+
+    *p++ = (uint8_t)((VCRL_TYPE_REPORT << 4) | (keyframe ? VCRL_TAG_KEYFRAME : 0) | (slot & VCRL_TAG_SLOT));
+    p = vcrlPutVarint(p, timeDelta);
+
+    if (keyframe)
+    {
+        // Store the whole report as a single run
+        p = vcrlPutVarint(p, length);
+        p = vcrlPutVarint(p, 1);
+        p = vcrlPutVarint(p, 0);
+        p = vcrlPutVarint(p, length);
+        for (i = 0; i < length; i++)
+            *p++ = state->data[i] = data[i];
+        state->length = length;
+        state->valid = 1;
+        return p;
+    }
+
+    // Store each run of changed bytes as the XOR with the old values
+    p = vcrlPutVarint(p, runs);
+    uint32_t runEnd = 0;
+    for (i = 0; i < length; i++)
+    {
+        if (data[i] == state->data[i]) continue;
+        uint32_t start = i;
+        while (i < length && data[i] != state->data[i]) i++;
+        p = vcrlPutVarint(p, start - runEnd);
+        p = vcrlPutVarint(p, i - start);
+        for (uint32_t j = start; j < i; j++)
+        {
+            *p++ = data[j] ^ state->data[j];
+            state->data[j] = data[j];
+        }
+        runEnd = i;
+    }
+    return p;
+}
+
+// Write a device record for a slot
+static inline uint8_t *vcrlPutDevice(uint8_t *p, int slot, uint64_t timeDelta, uint16_t vid, uint16_t pid)
+{
+    *p++ = (uint8_t)((VCRL_TYPE_DEVICE << 4) | (slot & VCRL_TAG_SLOT));
+    p = vcrlPutVarint(p, timeDelta);
+    p = vcrlPutVarint(p, vid);
+    return vcrlPutVarint(p, pid);
+}
+
+// Write a dropped record
+static inline uint8_t *vcrlPutDropped(uint8_t *p, uint64_t timeDelta, uint32_t count)
+{
+    *p++ = (uint8_t)(VCRL_TYPE_DROPPED << 4);
+    p = vcrlPutVarint(p, timeDelta);
+    return vcrlPutVarint(p, count);
+}
+
+// Get the type of the record at p, which must be before the end of the log
+static inline int vcrlRecordType(const uint8_t *p)
+{
+    return (*p & VCRL_TAG_TYPE) >> 4;
+}
+
+// Decode one device record. Returns the end of the record, or NULL if it's malformed.
+static inline const uint8_t *vcrlDecodeDevice(const uint8_t *p, const uint8_t *end, uint64_t *time, int *slotOut,
+    uint16_t *vidOut, uint16_t *pidOut)
+{
+    uint64_t timeDelta, vid, pid;
+
+    if (p >= end || vcrlRecordType(p) != VCRL_TYPE_DEVICE)
+        return NULL;
+
+    int slot = *p++ & VCRL_TAG_SLOT;
+    if (!(p = vcrlGetVarint(p, end, &timeDelta)) || !(p = vcrlGetVarint(p, end, &vid)) ||
+        !(p = vcrlGetVarint(p, end, &pid)) || vid > 0xFFFF || pid > 0xFFFF)
+        return NULL;
+
+    *time += timeDelta;
+    *slotOut = slot;
+    *vidOut = (uint16_t)vid;
+    *pidOut = (uint16_t)pid;
+    return p;
+}
+
+// Decode one dropped record. Returns the end of the record, or NULL if it's malformed.
+static inline const uint8_t *vcrlDecodeDropped(const uint8_t *p, const uint8_t *end, uint64_t *time, uint64_t *countOut)
+{
+    uint64_t timeDelta, count;
+
+    if (p >= end || vcrlRecordType(p) != VCRL_TYPE_DROPPED)
+        return NULL;
+
+    p++;
+    if (!(p = vcrlGetVarint(p, end, &timeDelta)) || !(p = vcrlGetVarint(p, end, &count)))
+        return NULL;
+
+    *time += timeDelta;
+    *countOut = count;
+    return p;
+}
+
+// Decode one report record and apply it to the slot states. Returns the end of the record, or NULL if it's malformed.
+static inline const uint8_t *vcrlDecodeRecord(const uint8_t *p, const uint8_t *end, VcrlSlot *slots,
+    uint64_t *time, int *slotOut, int *keyframeOut)
+{
+    uint64_t timeDelta, length, runs, skip, count;
+
+    if (p >= end)
+        return NULL;
+
+    uint8_t tag = *p++;
+    if ((tag & VCRL_TAG_TYPE) != (VCRL_TYPE_REPORT << 4))
+        return NULL;
+
+    int slot = tag & VCRL_TAG_SLOT;
+    int keyframe = (tag & VCRL_TAG_KEYFRAME) != 0;
+    VcrlSlot *state = &slots[slot];
+
+    if (!(p = vcrlGetVarint(p, end, &timeDelta)))
+        return NULL;
+    *time += timeDelta;
+
+    if (keyframe)
+    {
+        // Keyframes are relative to an all-zero report
+        if (!(p = vcrlGetVarint(p, end, &length)) || length > VCRL_MAX_REPORT)
+            return NULL;
+        for (uint32_t i = 0; i < VCRL_MAX_REPORT; i++)
+            state->data[i] = 0;
+        state->length = (uint32_t)length;
+        state->valid = 1;
+    }
+    else if (!state->valid)
+    {
+        return NULL;
+    }
+
+    if (!(p = vcrlGetVarint(p, end, &runs)))
+        return NULL;
+
+    // XOR each run into the report
+    uint32_t offset = 0;
+    for (uint64_t r = 0; r < runs; r++)
+    {
+        if (!(p = vcrlGetVarint(p, end, &skip)) || !(p = vcrlGetVarint(p, end, &count)))
+            return NULL;
+        // Check each value on its own so huge ones can't wrap around
+        if (skip > state->length - offset || count > state->length - offset - skip || (uint64_t)(end - p) < count)
+            return NULL;
+        offset += (uint32_t)skip;
+        for (uint64_t i = 0; i < count; i++)
+            state->data[offset++] ^= *p++;
+    }
+
+    *slotOut = slot;
+    *keyframeOut = keyframe;
+    return p;
+}
+
+#endif // VITACONTROL_RAWLOG_H
@@ -0,0 +1,159 @@
+#include <psp2kern/kernel/threadmgr.h>
+
+#include "capture.h"
+
+// Queued records (must be a power of 2)
+#define RECORD_COUNT 256
+
+#define FLAG_DATA (1 << 0)
+#define FLAG_EXIT (1 << 1)
+
+volatile bool Capture::enabled = false;
+
+// Single-producer single-consumer queue: only the bluetooth callback writes, and readers take turns with a mutex
+static VitacontrolCaptureRecord records[RECORD_COUNT];
+static volatile uint32_t writeIndex = 0;
+static volatile uint32_t readIndex = 0;
+static volatile uint32_t dropped = 0;
+
+// Set while a reader is blocked, so the producer only signals when someone is listening
+static volatile bool readerWaiting = false;
+
+static SceUID eventFlagUid = -1;
+static SceUID mutexUid = -1;
+
+void Capture::init()
+{
+    eventFlagUid = ksceKernelCreateEventFlag("vitacontrol_capture_flag", 0, 0, nullptr);
+    mutexUid = ksceKernelCreateMutex("vitacontrol_capture_mutex", 0, 0, nullptr);
+}
+
+void Capture::deinit()
+{
+    enabled = false;
+
+    // Wake up any blocked reader, and wait for it to leave by taking the mutex, before cleaning up; the mutex is deleted
+    // while it's held, so later readers fail to lock it instead of getting in
+    if (eventFlagUid > 0)
+        ksceKernelSetEventFlag(eventFlagUid, FLAG_EXIT);
+    if (mutexUid > 0)
+        ksceKernelLockMutex(mutexUid, 1, nullptr);
+
+    if (eventFlagUid > 0)
+    {
+        ksceKernelDeleteEventFlag(eventFlagUid);
+        eventFlagUid = -1;
+    }
+
+    if (mutexUid > 0)
+    {
+        ksceKernelDeleteMutex(mutexUid);
+        mutexUid = -1;
+    }
+}
+
+int Capture::setEnabled(bool enable)
+{
+    int res = ksceKernelLockMutex(mutexUid, 1, nullptr);
+    if (res < 0)
+        return res;
+
+    // Start each capture from an empty queue
+    if (enable && !enabled)
+        readIndex = writeIndex;
+
+    enabled = enable;
+    ksceKernelUnlockMutex(mutexUid, 1);
+    return 0;
+}
+
+void Capture::push(int slot, const uint8_t *buffer, size_t length)
+{
+    // Drop the record if the reader has fallen behind, rather than waiting
+    uint32_t index = writeIndex;
+    if (index - readIndex >= RECORD_COUNT)
+    {
+        dropped = dropped + 1;
+        return;
+    }
+
+    // Fill the record, then publish it
+    VitacontrolCaptureRecord &record = records[index & (RECORD_COUNT - 1)];
+    record.time   = ksceKernelGetSystemTimeWide();
+    record.slot   = slot;
+    record.length = (length > VITACONTROL_CAPTURE_REPORT_SIZE) ? VITACONTROL_CAPTURE_REPORT_SIZE : length;
+    for (size_t i = 0; i < record.length; i++)
+        record.data[i] = buffer[i];
+
+    __sync_synchronize();
+    writeIndex = index + 1;
+
+    // Wake up the reader if it's blocked waiting for data
+    __sync_synchronize();
+    if (readerWaiting)
+        ksceKernelSetEventFlag(eventFlagUid, FLAG_DATA);
+}
+
+int Capture::read(VitacontrolCaptureRecord *userRecords, int count, uint32_t timeout)
+{
+    if (!userRecords || count <= 0)
+        return 0;
+
+    int res = ksceKernelLockMutex(mutexUid, 1, nullptr);
+    if (res < 0)
+        return res;
+
+    uint32_t index = readIndex;
+    uint32_t end = writeIndex;
+
+    // Block until a record arrives if none are pending
+    if (index == end && timeout > 0)
+    {
+        // Announce the wait before checking again, so a record pushed in between can't be missed
+        ksceKernelClearEventFlag(eventFlagUid, ~FLAG_DATA);
+        readerWaiting = true;
+        __sync_synchronize();
+
+        if (writeIndex == index)
+        {
+            uint32_t outBits = 0;
+            SceUInt wait = timeout;
+            ksceKernelWaitEventFlag(eventFlagUid, FLAG_DATA | FLAG_EXIT, SCE_EVENT_WAITOR, &outBits, &wait);
+        }
+
+        readerWaiting = false;
+        end = writeIndex;
+    }
+    __sync_synchronize();
+
+    // Copy the pending records out in at most two contiguous chunks
+    uint32_t total = end - index;
+    if (total > (uint32_t)count)
+        total = count;
+
+    uint32_t copied = 0;
+    while (copied < total)
+    {
+        uint32_t start = (index + copied) & (RECORD_COUNT - 1);
+        uint32_t chunk = RECORD_COUNT - start;
+        if (chunk > total - copied)
+            chunk = total - copied;
+
+        res = ksceKernelMemcpyKernelToUser(&userRecords[copied], &records[start], chunk * sizeof(VitacontrolCaptureRecord));
+        if (res < 0)
+            break;
+        copied += chunk;
+    }
+
+    // Hand the copied records back to the producer
+    __sync_synchronize();
+    readIndex = index + copied;
+
+    ksceKernelUnlockMutex(mutexUid, 1);
+    return (copied == 0 && res < 0) ? res : (int)copied;
+}
+
+uint32_t Capture::getDropped()
+{
+    return dropped;
+}
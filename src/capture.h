@@ -0,0 +1,31 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/vitacontrol.h"
+
+// In-memory capture of raw input reports, read directly by companion apps through a syscall.
+// Reports are queued by the bluetooth callback without blocking, and copied out in batches by the reader.
+namespace Capture
+{
+
+extern volatile bool enabled;
+
+void init();
+void deinit();
+
+int setEnabled(bool enable);
+void push(int slot, const uint8_t *buffer, size_t length);
+int read(VitacontrolCaptureRecord *userRecords, int count, uint32_t timeout);
+uint32_t getDropped();
+
+inline bool isEnabled()
+{
+    return enabled;
+}
+
+};
+
+#endif // CAPTURE_H
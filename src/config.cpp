@@ -0,0 +1,271 @@
+#include <cstring>
+#include <psp2kern/ctrl.h>
+#include <psp2kern/io/fcntl.h>
+
+#include "config.h"
+#include "controller.h"
+#include "gyro_aim.h"
+#include "log.h"
+#include "polling.h"
+#include "profiles.h"
+#include "remap.h"
+#include "sticks.h"
+
+// Largest settings file that's read; anything after this is ignored
+#define CONFIG_SIZE 0x2000
+
+static char source[CONFIG_SIZE];
+static char buffer[CONFIG_SIZE + 1];
+
+struct ButtonName
+{
+    const char *name;
+    uint32_t mask;
+};
+
+static const ButtonName buttonNames[] =
+{
+    { "none",     0                 },
+    { "up",       SCE_CTRL_UP       },
+    { "down",     SCE_CTRL_DOWN     },
+    { "left",     SCE_CTRL_LEFT     },
+    { "right",    SCE_CTRL_RIGHT    },
+    { "cross",    SCE_CTRL_CROSS    },
+    { "circle",   SCE_CTRL_CIRCLE   },
+    { "square",   SCE_CTRL_SQUARE   },
+    { "triangle", SCE_CTRL_TRIANGLE },
+    { "l1",       SCE_CTRL_L1       },
+    { "r1",       SCE_CTRL_R1       },
+    { "l2",       SCE_CTRL_LTRIGGER },
+    { "r2",       SCE_CTRL_RTRIGGER },
+    { "l3",       SCE_CTRL_L3       },
+    { "r3",       SCE_CTRL_R3       },
+    { "start",    SCE_CTRL_START    },
+    { "select",   SCE_CTRL_SELECT   },
+    { "ps",       SCE_CTRL_PSBUTTON },
+    { "ext1",     SCE_CTRL_EXT1     },
+    { "ext2",     SCE_CTRL_EXT2     }
+};
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static char *trim(char *start, char *end)
+{
+    // Cut off surrounding whitespace in place, returning the new start
+    while (start < end && isSpace(*start)) start++;
+    while (end > start && isSpace(end[-1])) end--;
+    *end = '\0';
+    return start;
+}
+
+bool Config::parseInt(const char *value, int *result)
+{
+    // Accept decimal or 0x-prefixed hex, with an optional minus sign
+    bool negative = (*value == '-');
+    if (negative) value++;
+
+    int base = 10;
+    if (value[0] == '0' && (value[1] == 'x' || value[1] == 'X'))
+    {
+        base = 16;
+        value += 2;
+    }
+
+    if (!*value)
+        return false;
+
+    int number = 0;
+    for (; *value; value++)
+    {
+        int digit;
+        if (*value >= '0' && *value <= '9')
+            digit = *value - '0';
+        else if (base == 16 && *value >= 'a' && *value <= 'f')
+            digit = *value - 'a' + 10;
+        else if (base == 16 && *value >= 'A' && *value <= 'F')
+            digit = *value - 'A' + 10;
+        else
+            return false;
+        number = number * base + digit;
+    }
+
+    *result = negative ? -number : number;
+    return true;
+}
+
+bool Config::parseButtons(const char *value, uint32_t *result)
+{
+    // Buttons are named after the Vita's (and the DualShock's L1/R1/L2/R2) in lower case, and joined with "+"
+    uint32_t mask = 0;
+    while (true)
+    {
+        const char *end = strchr(value, '+');
+        size_t length = end ? (size_t)(end - value) : strlen(value);
+
+        size_t i = 0;
+        size_t count = sizeof(buttonNames) / sizeof(buttonNames[0]);
+        while (i < count && (strlen(buttonNames[i].name) != length || strncmp(value, buttonNames[i].name, length) != 0))
+            i++;
+        if (i == count)
+            return false;
+
+        mask |= buttonNames[i].mask;
+        if (!end)
+            break;
+        value = end + 1;
+    }
+
+    *result = mask;
+    return true;
+}
+
+static void setOption(const char *section, const char *argument, int line, const char *key, const char *value,
+    const char *block, bool warn)
+{
+    // Pass the option on to the module that owns the section; polling isn't part of profiles, so titles can't set it
+    bool handled = true;
+    if (strcmp(section, "sticks") == 0)
+        handled = Sticks::setOption(argument, key, value);
+    else if (strcmp(section, "gyro") == 0)
+        handled = GyroAim::setOption(argument, key, value);
+    else if (strcmp(section, "remap") == 0)
+        handled = Remap::setOption(argument, key, value);
+    else if (strcmp(section, "polling") == 0)
+        handled = !block && !*argument && Polling::setOption(key, value);
+
+    if (!handled && warn)
+        LOG_WARN(LOG_CORE, "Config line %d: bad option %s = %s\n", line, key, value);
+}
+
+static bool sameTitle(const char *a, const char *b)
+{
+    return (!a || !b) ? (a == b) : (strcmp(a, b) == 0);
+}
+
+static void parse(const char *source, int size, const char *title)
+{
+    // The parser cuts lines up in place, so work on a fresh copy for every pass
+    memcpy(buffer, source, size);
+    buffer[size] = '\0';
+
+    // Sections start out empty, so options before the first header are ignored
+    const char *section = "";
+    const char *argument = "";
+    const char *block = nullptr;
+    int line = 0;
+
+    // Problems are reported once, from the default pass or the pass of the title they're under
+    bool warn = !title;
+
+    char *p = buffer;
+    char *end = buffer + size;
+    while (p < end)
+    {
+        // Find the end of the line and strip comments from it
+        char *lineStart = p;
+        while (p < end && *p != '\n') p++;
+        char *lineEnd = p++;
+        line++;
+        for (char *c = lineStart; c < lineEnd; c++)
+        {
+            if (*c == '#' || *c == ';')
+            {
+                lineEnd = c;
+                break;
+            }
+        }
+
+        char *text = trim(lineStart, lineEnd);
+        if (!*text)
+            continue;
+
+        if (*text == '[')
+        {
+            // Section header, with an optional argument after a space
+            char *close = text;
+            while (*close && *close != ']') close++;
+            char *space = text + 1;
+            while (space < close && !isSpace(*space)) space++;
+            argument = (space < close) ? trim(space + 1, close) : "";
+            section = trim(text + 1, space);
+
+            // "[title ID]" starts the settings for one title, and "[title]" goes back to the defaults
+            if (strcmp(section, "title") == 0)
+            {
+                block = *argument ? argument : nullptr;
+                warn = sameTitle(block, title);
+                if (block && !title && !Profiles::add(block))
+                    LOG_WARN(LOG_CORE, "Config line %d: no room for a profile for %s\n", line, block);
+                section = "";
+            }
+            continue;
+        }
+
+        // Default options are part of every profile, and title options only of their own
+        if (block && !sameTitle(block, title))
+            continue;
+
+        // Split the option at the equals sign
+        char *equalsSign = text;
+        while (*equalsSign && *equalsSign != '=') equalsSign++;
+        if (!*equalsSign)
+        {
+            if (warn)
+                LOG_WARN(LOG_CORE, "Config line %d: expected key = value\n", line);
+            continue;
+        }
+
+        char *value = trim(equalsSign + 1, equalsSign + 1 + strlen(equalsSign + 1));
+        char *key = trim(text, equalsSign);
+        setOption(section, argument, line, key, value, block, warn);
+    }
+}
+
+static void compile(const char *source, int size, Profile *profile)
+{
+    // Start from the built-in settings, apply the defaults and then the title's own options on top
+    Sticks::reset();
+    GyroAim::reset();
+    Remap::reset();
+    if (source)
+    {
+        parse(source, size, nullptr);
+        if (profile->titleId[0])
+            parse(source, size, profile->titleId);
+    }
+
+    for (int port = 0; port < MAX_PORTS; port++)
+    {
+        Sticks::compile(port, profile->ports[port].sticks);
+        GyroAim::compile(port, profile->ports[port].gyro);
+        Remap::compile(port, profile->ports[port].remap);
+    }
+}
+
+void Config::load()
+{
+    SceUID fd = ksceIoOpen(CONFIG_PATH, SCE_O_RDONLY, 0);
+    if (fd < 0)
+    {
+        LOG_INFO(LOG_CORE, "No config at %s, using defaults\n", CONFIG_PATH);
+        compile(nullptr, 0, Profiles::getDefault());
+        Profiles::activate(nullptr);
+        return;
+    }
+
+    int size = ksceIoRead(fd, source, CONFIG_SIZE);
+    ksceIoClose(fd);
+    if (size < 0)
+        size = 0;
+
+    // The default pass also finds the titles that have their own settings, which are each compiled into a profile
+    compile(source, size, Profiles::getDefault());
+    for (int i = 0; i < Profiles::getCount(); i++)
+        compile(source, size, Profiles::get(i));
+
+    LOG_INFO(LOG_CORE, "Loaded config from %s, with %d title profiles\n", CONFIG_PATH, Profiles::getCount());
+    Profiles::activate(nullptr);
+}
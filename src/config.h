@@ -0,0 +1,21 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Settings file, read once when the plugin starts (ur0 is mounted by then, unlike ux0).
+// Lines are "key = value" under "[section]" or "[section argument]" headers, and "#" or ";" start a comment.
+// Each section is handed to the module it configures, and unknown sections and keys are ignored. Sections after a
+// "[title ID]" header only apply while that title is running, on top of the ones before the first such header.
+#define CONFIG_PATH "ur0:tai/vitacontrol.txt"
+
+#include <stdint.h>
+
+namespace Config
+{
+
+void load();
+bool parseInt(const char *value, int *result);
+bool parseButtons(const char *value, uint32_t *result);
+
+};
+
+#endif // CONFIG_H
@@ -1,9 +1,17 @@
 #include <cstring>
 #include <psp2kern/bt.h>
 #include <psp2kern/kernel/debug.h>
+#include <psp2kern/kernel/threadmgr.h>
 
 #include "controller.h"
+#include "crc32.h"
+#include "device_cache.h"
+#include "gyro_aim.h"
+#include "log.h"
 #include "mempool.h"
+#include "profiles.h"
+#include "remap.h"
+#include "sticks.h"
 #include "controllers/dualshock3_controller.h"
 #include "controllers/dualshock4_controller.h"
 #include "controllers/dualsense_controller.h"
@@ -12,27 +20,35 @@
 #include "controllers/switch_pro_controller.h"
 #include "controllers/eightbitdo_lite2_controller.h"
 
-// Logging function declaration
-extern "C" {
-    int ksceDebugPrintf(const char *fmt, ...);
-}
+// Rumble rate limits, in microseconds
+#define RUMBLE_MIN_INTERVAL       8000
+#define RUMBLE_MAX_INTERVAL     128000
+#define RUMBLE_REFRESH_INTERVAL 1000000
+
+// Input reports that should arrive between rumble updates before they're considered to be crowded out
+#define RUMBLE_MIN_REPORTS 2
+
+// Time after which a request with no reply is considered lost, in microseconds
+#define REQUEST_TIMEOUT 100000
+
+// Time before a read that couldn't be sent is tried again, in microseconds
+#define READ_RETRY_DELAY 10000
 
-// Logging macro
-#define LOG(...) ksceDebugPrintf("[VitaControl] " __VA_ARGS__)
+// Times a setup step is retried before it's skipped, so a controller that never answers still gets its input read
+#define INIT_MAX_RETRIES 4
+
+// Smallest changes that count as input for idle detection: stick and trigger movement in 16-bit units (2 steps of the
+// system's 8 bits, above sensor noise), and rotation in rad/s with IMU_SHIFT fractional bits (5 degrees per second)
+#define ACTIVE_AXIS_CHANGE 0x200
+#define ACTIVE_ROTATION    5719
 
 inline void* operator new(std::size_t, void* __p) throw() { return __p; }
 
 #define DECL_CONTROLLER(vid, pid, name) \
     case ((vid) << 16) | (pid): return new(Mempool::alloc(sizeof(name))) name(mac0, mac1, port)
 
-Controller *Controller::makeController(uint32_t mac0, uint32_t mac1, int port)
+Controller *Controller::makeController(uint32_t mac0, uint32_t mac1, int port, const uint16_t *id)
 {
-    // Get the VID and PID of the device with the given MAC address
-    uint16_t id[2];
-    ksceBtGetVidPid(mac0, mac1, id);
-
-    LOG("  Device VID:PID = 0x%04X:0x%04X\n", id[0], id[1]);
-
     // Match the VID and PID to a controller type, and create one if it exists
     switch ((id[0] << 16) | id[1])
     {
@@ -52,44 +68,362 @@ Controller *Controller::makeController(uint32_t mac0, uint32_t mac1, int port)
         DECL_CONTROLLER(0x057E, 0x2009, SwitchProController);
     }
 
-    LOG("  No matching controller found for VID:PID 0x%04X:0x%04X\n", id[0], id[1]);
+    // Only keep devices that have a driver
+    DeviceCache::remove(mac0, mac1);
+    LOG_WARN(LOG_DRIVER, "  No matching controller found for VID:PID 0x%04X:0x%04X\n", id[0], id[1]);
     return nullptr;
 }
 
+void Controller::start(uint8_t *buffer, size_t length)
+{
+    // Clear toggles and turbo left over from the slot's last controller
+    Remap::resetState(port);
+
+    // Run the driver's setup from the first step
+    readBuffer = buffer;
+    readLength = length;
+    initStep = -1;
+    ready = false;
+    nextInitStep();
+}
+
+void Controller::nextInitStep()
+{
+    // Move on to the next step the driver still needs, or start reading input continuously once there are none left
+    initRetries = 0;
+    do
+        initStep++;
+    while (initStep < initStepCount && !needsInitStep(initStep));
+
+    if (initStep >= initStepCount)
+    {
+        LOG_INFO(LOG_DRIVER, "  Controller ready (slot %d)\n", port);
+        ready = true;
+        requestRead();
+        return;
+    }
+    sendInitStep();
+}
+
+void Controller::sendInitStep()
+{
+    // Send the step's request, reading input alongside it if that's how it's answered
+    const InitStep &step = initSteps[initStep];
+    LOG_DEBUG(LOG_DRIVER, "  Setup step %d, try %d (slot %d)\n", initStep, initRetries + 1, port);
+    initTime = ksceKernelGetSystemTimeWide();
+    if (step.request == HID_REQUEST_READ || step.reportId)
+        requestRead();
+
+    // Don't reuse the request structure while the last one is still waiting for its reply; the step is tried again
+    // after its timeout instead
+    if (step.request != HID_REQUEST_READ && !isRequestBusy(step.request, initTime))
+        sendInitRequest(initStep);
+}
+
+bool Controller::wantsInput()
+{
+    // Input is only read during setup when a step is waiting for it
+    if (ready)
+        return true;
+    const InitStep &step = initSteps[initStep];
+    return step.request == HID_REQUEST_READ || step.reportId;
+}
+
+uint64_t Controller::poll(uint64_t time)
+{
+    // Send a read that was put off once it's due
+    if (readTime && time >= readTime)
+        requestRead();
+    if (ready)
+        return readTime;
+
+    // Try a setup step again if it wasn't answered in time, or skip it after too many tries
+    const InitStep &step = initSteps[initStep];
+    if (time - initTime >= step.timeout)
+    {
+        if (initRetries < INIT_MAX_RETRIES)
+        {
+            initRetries++;
+            sendInitStep();
+        }
+        else
+        {
+            LOG_WARN(LOG_DRIVER, "  Setup step %d got no reply, skipping it (slot %d)\n", initStep, port);
+            nextInitStep();
+            if (ready)
+                return readTime;
+        }
+    }
+
+    // Wake up for whichever comes first of the step's timeout and a deferred read
+    uint64_t timeout = initTime + initSteps[initStep].timeout;
+    return (readTime && readTime < timeout) ? readTime : timeout;
+}
+
 int Controller::requestReport(uint8_t type, uint8_t *buffer, size_t length)
 {
-    static SceBtHidRequest request;
-    memset(&request, 0, sizeof(SceBtHidRequest));
+    // Each request type has its own request, since a read and a write can be in flight at the same time
+    SceBtHidRequest *request = &requests[type];
+    memset(request, 0, sizeof(SceBtHidRequest));
 
     // Clear the buffer for read requests
     if (type == HID_REQUEST_READ)
         memset(buffer, 0, length);
 
     // Build a report request
-    request.type   = type;
-    request.buffer = buffer;
-    request.length = length;
-    request.next   = &request;
+    request->type   = type;
+    request->buffer = buffer;
+    request->length = length;
+    request->next   = request;
 
-    // Send the request to the controller
-    int ret = ksceBtHidTransfer(mac0, mac1, &request);
+    // Send the request to the controller, replacing any read that was put off
+    if (type == HID_REQUEST_READ)
+        readTime = 0;
+    int ret = ksceBtHidTransfer(mac0, mac1, request);
+    requestsPending[type] = (ret >= 0);
+    requestTimes[type] = ksceKernelGetSystemTimeWide();
+
+    // A read the bluetooth stack refused was never queued, so it's safe to send again shortly; one that was queued is
+    // left alone until its reply, since some controllers only report when their input changes
+    if (type == HID_REQUEST_READ && ret < 0)
+    {
+        LOG_DEBUG(LOG_DRIVER, "  Read failed: 0x%08X, trying again (slot %d)\n", ret, port);
+        readTime = requestTimes[type] + READ_RETRY_DELAY;
+    }
     return ret;
 }
 
-uint32_t Controller::calculateCrc(uint8_t *buffer, size_t length)
+bool Controller::isRequestBusy(uint8_t type, uint64_t time)
+{
+    // A request is in use until it's replied to, or until its reply is considered lost
+    return requestsPending[type] && time - requestTimes[type] < REQUEST_TIMEOUT;
+}
+
+void Controller::requestRead()
+{
+    // Only one read can be in flight, since they all share the request structure
+    if (!requestsPending[HID_REQUEST_READ])
+        requestReport(HID_REQUEST_READ, readBuffer, readLength);
+}
+
+void Controller::completeRequest(uint8_t type)
+{
+    // Mark a request as replied to, so its request structure can be reused
+    requestsPending[type] = false;
+
+    // Move on from a setup step that only needed its request answered
+    if (!ready && type != HID_REQUEST_READ && initSteps[initStep].request == type && !initSteps[initStep].reportId)
+        nextInitStep();
+}
+
+uint8_t Controller::getCachedMode()
+{
+    const DeviceInfo *info = DeviceCache::find(mac0, mac1);
+    return info ? info->mode : 0;
+}
+
+void Controller::setCachedMode(uint8_t mode)
+{
+    DeviceCache::setMode(mac0, mac1, mode);
+}
+
+static inline uint16_t scaleTouch(int coord, int dead, uint32_t scale, int vitaSize)
 {
-    // Calculate the CRC of the given data (used in requests for some controllers)
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < length; i++)
+    if (coord <= dead)
+        return 0;
+    uint32_t value = ((uint64_t)(coord - dead) * scale) >> TOUCH_SCALE_SHIFT;
+    return (value < (uint32_t)vitaSize) ? value : (vitaSize - 1);
+}
+
+static inline bool axisChanged(uint16_t value, uint16_t reference)
+{
+    return (value > reference) ? (value - reference >= ACTIVE_AXIS_CHANGE) : (reference - value >= ACTIVE_AXIS_CHANGE);
+}
+
+void Controller::handleReport(uint8_t *buffer, size_t length, uint64_t time)
+{
+    // Pick up the settings of the running title, which stay the same for the whole report
+    profile = Profiles::getPort(port);
+
+    // Let the driver decode the report, then shape its sticks and remap its buttons into the data that gets read back
+    reportTime = time;
+    processReport(buffer, length);
+
+    // Move on from a setup step that was waiting for this report
+    if (!ready)
     {
-        uint8_t ch = buffer[i];
-        for (size_t j = 0; j < 8; j++)
+        const InitStep &step = initSteps[initStep];
+        if (step.reportId ? (buffer[0] == step.reportId) : (step.request == HID_REQUEST_READ))
+            nextInitStep();
+    }
+
+    // Drivers only fill in the sticks (centred) or buttons once they decode a report they understand
+    if (!decodedInput)
+        decodedInput = controlData.buttons || controlData.leftX || controlData.leftY || controlData.rightX || controlData.rightY;
+    Sticks::apply(profile->sticks, &controlData, &outputData);
+    Remap::apply(profile->remap, port, time, &outputData);
+
+    // Add gyro aiming from the report's motion samples, averaged if it had several, or the last value if it had none
+    if (aimSamples)
+    {
+        for (int i = 0; i < 2; i++)
         {
-            uint32_t b = (ch ^ crc) & 1;
-            crc >>= 1;
-            if (b) crc = crc ^ 0xEDB88320;
-            ch >>= 1;
+            aimDeflection[i] = (aimSamples > 1) ? aimSum[i] / aimSamples : aimSum[i];
+            aimSum[i] = 0;
         }
+        aimSamples = 0;
+    }
+    GyroAim::apply(profile->gyro, aimDeflection, &outputData);
+
+    // Note when the output last changed, so controllers nobody is using can be read less often
+    bool touch = outputTouch.touchActive[0] || outputTouch.touchActive[1];
+    if (!activeTime || outputData.buttons != activeData.buttons || touch != activeTouch ||
+        axisChanged(outputData.leftX, activeData.leftX) || axisChanged(outputData.leftY, activeData.leftY) ||
+        axisChanged(outputData.rightX, activeData.rightX) || axisChanged(outputData.rightY, activeData.rightY) ||
+        axisChanged(outputData.leftTrigger, activeData.leftTrigger) ||
+        axisChanged(outputData.rightTrigger, activeData.rightTrigger))
+    {
+        activeData = outputData;
+        activeTouch = touch;
+        activeTime = time;
+    }
+}
+
+void Controller::updateTouch(uint64_t time)
+{
+    if (!touchDescriptor)
+        return;
+
+    // Scale touches to the Vita's touchscreen once here, so the touch hooks only have to copy them
+    outputTouch = touchData;
+    for (int i = 0; i < 2; i++)
+    {
+        outputTouch.touchX[i] = scaleTouch(touchData.touchX[i], touchDescriptor->deadX, touchDescriptor->scaleX, TOUCHSCREEN_WIDTH);
+        outputTouch.touchY[i] = scaleTouch(touchData.touchY[i], touchDescriptor->deadY, touchDescriptor->scaleY, TOUCHSCREEN_HEIGHT);
+    }
+
+    // Add the frame to the history, invalidating the entry it replaces first in case it's being read
+    uint32_t counter = touchCount + 1;
+    TouchFrame *frame = &touchFrames[counter % TOUCH_HISTORY];
+    frame->counter = 0;
+    __sync_synchronize();
+    frame->time = time;
+    frame->data = outputTouch;
+    __sync_synchronize();
+    frame->counter = counter;
+    touchCount = counter;
+}
+
+bool Controller::getTouchFrame(uint64_t time, TouchData *data)
+{
+    // Walk back from the newest frame to the last one at or before the given time, or the oldest one still kept
+    bool found = false;
+    uint32_t latest = touchCount;
+    for (uint32_t counter = latest; counter && latest - counter < TOUCH_HISTORY - 1; counter--)
+    {
+        const volatile TouchFrame *frame = &touchFrames[counter % TOUCH_HISTORY];
+        if (frame->counter != counter)
+            break;
+        __sync_synchronize();
+        TouchFrame copy = *(const TouchFrame*)frame;
+        __sync_synchronize();
+        if (frame->counter != counter)
+            break;
+
+        *data = copy.data;
+        found = true;
+        if (copy.time <= time)
+            break;
+    }
+    return found;
+}
+
+void Controller::updateMotion(uint64_t time)
+{
+    // Fuse the motion sample the driver just decoded into the orientation, if the sensor resolutions are known
+    if (!imuDescriptor)
+        return;
+    imu.update(*imuDescriptor, motionState.accel, motionState.gyro, time);
+
+    // Turning the controller counts as input, for games that read motion
+    const int32_t *rate = imu.getRate();
+    for (int i = 0; i < 3; i++)
+    {
+        if (rate[i] > ACTIVE_ROTATION || rate[i] < -ACTIVE_ROTATION)
+            activeTime = time;
     }
-    return ~crc;
+
+    // Work out gyro aiming for every sample too, with the buttons as they were decoded
+    int32_t deflection[2];
+    GyroAim::update(profile->gyro, *imuDescriptor, rate, controlData.buttons, deflection);
+    aimSum[0] += deflection[0];
+    aimSum[1] += deflection[1];
+    aimSamples++;
+}
+
+void Controller::updateRumble()
+{
+    // This is called after each input report, so count them to measure what's getting through between rumble updates
+    rumbleReports++;
+
+    // Writes during setup are left to the setup steps
+    if (!ready)
+        return;
+
+    // Only send a rumble update if the value changed, or to refresh motors that would otherwise time out
+    uint16_t requested = rumbleRequested;
+    uint64_t now = ksceKernelGetSystemTimeWide();
+    uint64_t elapsed = now - rumbleSentTime;
+    if (requested == rumbleSent && (!requested || elapsed < RUMBLE_REFRESH_INTERVAL))
+        return;
+
+    // Merge updates that come in faster than the current interval, and wait for the last write to be replied to
+    if (elapsed < rumbleInterval || isRequestBusy(HID_REQUEST_WRITE, now))
+        return;
+
+    // Back off if input reports were crowded out since the last update, and speed up again when they weren't
+    if (rumbleReports < RUMBLE_MIN_REPORTS)
+        rumbleInterval = (rumbleInterval * 2 > RUMBLE_MAX_INTERVAL) ? RUMBLE_MAX_INTERVAL : rumbleInterval * 2;
+    else
+        rumbleInterval = (rumbleInterval / 2 < RUMBLE_MIN_INTERVAL) ? RUMBLE_MIN_INTERVAL : rumbleInterval / 2;
+
+    // Send the latest requested value to the controller
+    sendRumble(requested & 0xFF, requested >> 8);
+    rumbleSent = requested;
+    rumbleSentTime = now;
+    rumbleReports = 0;
+}
+
+bool Controller::checkInputCrc(const uint8_t *buffer, size_t length)
+{
+    // Input report CRCs cover the 0xA1 HID header byte, which isn't in the buffer, so start from its precomputed state
+    static constexpr uint8_t header[] = { 0xA1 };
+    static constexpr uint32_t headerState = Crc32::updateConst(Crc32::INITIAL_STATE, header, sizeof(header));
+
+    // Compare the CRC of the data with the one appended to the end of the report
+    uint32_t crc = Crc32::finish(Crc32::update(headerState, buffer, length - 4));
+    uint32_t reportCrc = (uint32_t)buffer[length - 4] << 0  | (uint32_t)buffer[length - 3] << 8 |
+                         (uint32_t)buffer[length - 2] << 16 | (uint32_t)buffer[length - 1] << 24;
+
+    if (crc == reportCrc)
+    {
+        inputCrcVerified = true;
+        return true;
+    }
+
+    // Only drop reports once a valid CRC has been seen, in case the report arrived without one
+    if (!inputCrcVerified)
+        return true;
+    droppedReports++;
+    return false;
+}
+
+void Controller::writeOutputCrc(uint8_t *buffer, size_t length, uint32_t headerState, size_t headerLength)
+{
+    // Calculate the CRC of the data following the constant header and append it to the end
+    uint32_t crc = Crc32::finish(Crc32::update(headerState, buffer + headerLength, length - headerLength - 4));
+    buffer[length - 4] = crc >>  0;
+    buffer[length - 3] = crc >>  8;
+    buffer[length - 2] = crc >> 16;
+    buffer[length - 1] = crc >> 24;
 }
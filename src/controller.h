@@ -1,6 +1,19 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+#include <psp2kern/bt.h>
+
+#include "imu_fusion.h"
+
+// Controller slots, which settings and profiles are kept for
+#define MAX_PORTS 4
+
+#define TOUCHSCREEN_WIDTH  1920
+#define TOUCHSCREEN_HEIGHT 1080
+
+// Fractional bits of touch scaling multipliers, enough for results to match dividing exactly
+#define TOUCH_SCALE_SHIFT 24
+
 enum HidRequestType
 {
     HID_REQUEST_READ = 0,
@@ -34,65 +47,208 @@ enum SceCtrlButtonsExt
 	SCE_CTRL_EXT2 = 0x08000000
 };
 
+// Analog values are kept at 16 bits until they're written out to the system, centred at 0x8000 for sticks
 struct ControlData
 {
     uint32_t buttons = 0;
-    uint8_t leftX  = 0;
-    uint8_t leftY  = 0;
-    uint8_t rightX = 0;
-    uint8_t rightY = 0;
+    uint16_t leftX  = 0;
+    uint16_t leftY  = 0;
+    uint16_t rightX = 0;
+    uint16_t rightY = 0;
+    uint16_t leftTrigger  = 0;
+    uint16_t rightTrigger = 0;
 };
 
+// Scale analog values of other resolutions up to 16 bits, so the top bits are the same as before
+static inline uint16_t analog8(uint8_t value)   { return value * 0x101; }
+static inline uint16_t analog10(uint16_t value) { return (value << 6) | (value >> 4); }
+static inline uint16_t analog12(uint16_t value) { return (value << 4) | (value >> 8); }
+
 struct TouchData
 {
     bool touchActive[2] = {};
     uint8_t touchId[2] = {};
     uint16_t touchX[2] = {};
     uint16_t touchY[2] = {};
-    uint16_t touchWidth = 0;
-    uint16_t touchHeight = 0;
-    uint16_t touchDeadX = 0;
-    uint16_t touchDeadY = 0;
 };
 
+// Touch frames kept for functions that read several at once
+#define TOUCH_HISTORY 16
+
+// A scaled touch frame with its time; counters start at 1 and increase with every frame
+struct TouchFrame
+{
+    uint64_t time;
+    uint32_t counter;
+    TouchData data;
+};
+
+// Touchpad borders to ignore, and multipliers that scale the rest to the Vita's front touchscreen
+struct TouchDescriptor
+{
+    uint16_t deadX;
+    uint16_t deadY;
+    uint32_t scaleX;
+    uint32_t scaleY;
+};
+
+constexpr uint32_t touchScale(int vitaSize, int size)
+{
+    // Round up, so that multiplying and shifting gives the same results as dividing
+    return (((uint64_t)vitaSize << TOUCH_SCALE_SHIFT) + size - 1) / size;
+}
+
+constexpr TouchDescriptor makeTouchDescriptor(int width, int height, int deadX, int deadY)
+{
+    return { (uint16_t)deadX, (uint16_t)deadY,
+        touchScale(TOUCHSCREEN_WIDTH, width - deadX * 2), touchScale(TOUCHSCREEN_HEIGHT, height - deadY * 2) };
+}
+
+// Raw accelerometer and gyroscope readings for the X, Y and Z axes
 struct MotionState
 {
-    int16_t accelerX = 0;
-    int16_t accelerY = 0;
-    int16_t accelerZ = 0;
-    int16_t velocityX = 0;
-    int16_t velocityY = 0;
-    int16_t velocityZ = 0;
+    int16_t accel[3] = {};
+    int16_t gyro[3]  = {};
 };
 
+// A step of a driver's setup: the request it sends (HID_REQUEST_READ to only wait for input), the input report ID that
+// shows it worked (0 if the request's own reply is enough, or any report for a read), and how long to wait for that
+// before sending the request again, in microseconds
+struct InitStep
+{
+    uint8_t request;
+    uint8_t reportId;
+    uint32_t timeout;
+};
+
+// Compiled settings for the controller's slot, from the profile of the running title
+struct PortProfile;
+
 class Controller
 {
     public:
-        Controller(uint32_t mac0, uint32_t mac1, int port): mac0(mac0), mac1(mac1) {}
+        Controller(uint32_t mac0, uint32_t mac1, int port): mac0(mac0), mac1(mac1), port(port) {}
 
-        static Controller *makeController(uint32_t mac0, uint32_t mac1, int port);
+        static Controller *makeController(uint32_t mac0, uint32_t mac1, int port, const uint16_t *id);
 
+        void start(uint8_t *buffer, size_t length);
+        uint64_t poll(uint64_t time);
         int requestReport(uint8_t type, uint8_t *buffer, size_t length);
-        virtual void processReport(uint8_t *buffer, size_t length) = 0;
+        void requestRead();
+        void completeRequest(uint8_t type);
+        void handleReport(uint8_t *buffer, size_t length, uint64_t time);
+
+        void setRumble(uint8_t small, uint8_t large) { rumbleRequested = (large << 8) | small; }
+        void updateRumble();
 
-        const ControlData *getControlData()  { return &controlData; }
-        const TouchData   *getTouchData()    { return &touchData;   }
+        const ControlData *getControlData()  { return &outputData;  }
+        const TouchData   *getTouchData()    { return &outputTouch; }
         const MotionState *getMotionState()  { return &motionState; }
         uint8_t            getBatteryLevel() { return batteryLevel; }
 
+        bool getTouchFrame(uint64_t time, TouchData *data);
+        bool getImuState(ImuState *state) { return imuDescriptor && imu.read(state); }
+        bool getImuSample(uint32_t counter, ImuSample *sample) { return imuDescriptor && imu.readSample(counter, sample); }
+        uint32_t getImuSampleCount() { return imuDescriptor ? imu.getSampleCount() : 0; }
+
+        bool hasTouch()  { return touchDescriptor; }
+        bool hasMotion() { return imuDescriptor || rawMotion; }
+        bool hasFusedMotion() { return imuDescriptor; }
+
         uint32_t getMac0() { return mac0; }
         uint32_t getMac1() { return mac1; }
 
+        bool isReady() { return ready; }
+        bool wantsInput();
+        bool needsPoll() { return !ready || readTime; }
+        bool hasDecodedInput() { return decodedInput; }
+        uint64_t getActiveTime() { return activeTime; }
+        void deferRead(uint64_t time) { readTime = time; }
+        uint32_t getDroppedReports() { return droppedReports; }
+
     protected:
         ControlData controlData;
         TouchData   touchData;
         MotionState motionState;
         uint8_t     batteryLevel = 0;
 
-        static uint32_t calculateCrc(uint8_t *buffer, size_t length);
+        const TouchDescriptor *touchDescriptor = nullptr;
+        const ImuDescriptor   *imuDescriptor   = nullptr;
+
+        // Set by controllers that report motion without the resolutions needed for fusion
+        bool rawMotion = false;
+
+        uint64_t reportTime = 0;
+
+        // Setup steps, run in order from the time the controller connects before its input is read continuously
+        const InitStep *initSteps = nullptr;
+        int initStepCount = 0;
+
+        template <int count> void setInitSteps(const InitStep (&steps)[count])
+        {
+            initSteps = steps;
+            initStepCount = count;
+        }
+
+        void updateTouch() { updateTouch(reportTime); }
+        void updateTouch(uint64_t time);
+        void updateMotion() { updateMotion(reportTime); }
+        void updateMotion(uint64_t time);
+
+        uint8_t getCachedMode();
+        void setCachedMode(uint8_t mode);
+
+        bool checkInputCrc(const uint8_t *buffer, size_t length);
+        static void writeOutputCrc(uint8_t *buffer, size_t length, uint32_t headerState, size_t headerLength);
+
+        virtual void processReport(uint8_t *buffer, size_t length) = 0;
+        virtual void sendRumble(uint8_t small, uint8_t large) {}
+        virtual bool needsInitStep(int step) { return true; }
+        virtual void sendInitRequest(int step) {}
 
     private:
         uint32_t mac0, mac1;
+        int port;
+        ControlData outputData;
+        TouchData outputTouch;
+        TouchFrame touchFrames[TOUCH_HISTORY] = {};
+        volatile uint32_t touchCount = 0;
+        ImuFusion imu;
+        const PortProfile *profile = nullptr;
+        int32_t aimSum[2] = {};
+        int32_t aimDeflection[2] = {};
+        int aimSamples = 0;
+        bool inputCrcVerified = false;
+        uint32_t droppedReports = 0;
+
+        SceBtHidRequest requests[HID_REQUEST_FEATURE + 1] = {};
+        uint64_t requestTimes[HID_REQUEST_FEATURE + 1] = {};
+        bool requestsPending[HID_REQUEST_FEATURE + 1] = {};
+        bool decodedInput = false;
+
+        // Buffer that input reports are read into, and progress through the setup steps
+        uint8_t *readBuffer = nullptr;
+        size_t readLength = 0;
+        int initStep = -1;
+        int initRetries = 0;
+        uint64_t initTime = 0;
+        bool ready = false;
+
+        // Output the last change was measured from and when it happened, and when an idle controller is read next
+        ControlData activeData;
+        bool activeTouch = false;
+        uint64_t activeTime = 0;
+        uint64_t readTime = 0;
+
+        volatile uint16_t rumbleRequested = 0;
+        uint16_t rumbleSent = 0;
+        uint64_t rumbleSentTime = 0;
+        uint32_t rumbleInterval = 0;
+        uint32_t rumbleReports = 0;
+
+        bool isRequestBusy(uint8_t type, uint64_t time);
+        void nextInitStep();
+        void sendInitStep();
 };
 
 #endif // CONTROLLER_H
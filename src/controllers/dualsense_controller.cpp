@@ -1,6 +1,24 @@
+#include <cstring>
 #include <psp2kern/ctrl.h>
 
 #include "dualsense_controller.h"
+#include "../crc32.h"
+
+// Constant start of the output report, and its CRC state precomputed at compile time
+static constexpr uint8_t outputHeader[] = { 0xA2, 0x31, 0x02, 0x03, 0x14 };
+static constexpr uint32_t outputHeaderState = Crc32::updateConst(Crc32::INITIAL_STATE, outputHeader, sizeof(outputHeader));
+
+// Touchpad dimensions and dead borders
+static constexpr TouchDescriptor touchpad = makeTouchDescriptor(1920, 1070, 60, 60);
+
+// Motion sensor resolutions (8192 per g and 16 per degree per second), and yaw and pitch around the Y and X axes
+static constexpr ImuDescriptor imuSensors = makeImuDescriptor(8192, 16, -2, -1);
+
+// Setup: the output report that switches to extended mode, which is done once extended reports arrive
+static const InitStep initSequence[] =
+{
+    { HID_REQUEST_WRITE, 0x31, 250000 }
+};
 
 DualSenseController::DualSenseController(uint32_t mac0, uint32_t mac1, int port): Controller(mac0, mac1, port)
 {
@@ -20,41 +38,24 @@ DualSenseController::DualSenseController(uint32_t mac0, uint32_t mac1, int port)
         { 0x20, 0x00, 0x20 }, // Pink
     };
 
-    // Prepare a write request to switch to extended mode and set LED flags and colours
-    static uint8_t buffer[79] = {};
-    buffer[0]  = 0xA2;
-    buffer[1]  = 0x31;
-    buffer[2]  = 0x02;
-    buffer[3]  = 0x03;
-    buffer[4]  = 0x14;
-    buffer[41] = 0x02;
-    buffer[44] = 0x02;
-    buffer[46] = ledFlags[port];
-    buffer[47] = ledColours[port][0];
-    buffer[48] = ledColours[port][1];
-    buffer[49] = ledColours[port][2];
-
-    // Calculate the CRC of the data (including the 0xA2 byte) and append it to the end
-    uint32_t crc = calculateCrc(buffer, 75);
-    buffer[75] = crc >>  0;
-    buffer[76] = crc >>  8;
-    buffer[77] = crc >> 16;
-    buffer[78] = crc >> 24;
-
-    // Send the write request, omitting the 0xA2 byte
-    requestReport(HID_REQUEST_WRITE, buffer + 1, sizeof(buffer) - 1);
-
-    // Set the touchpad dimensions
-    touchData.touchWidth  = 1920;
-    touchData.touchHeight = 1070;
-    touchData.touchDeadX  =   60;
-    touchData.touchDeadY  =   60;
+    // Prepare a write request to switch to extended mode and set LED flags and colours, sent by the setup step
+    memcpy(outputReport, outputHeader, sizeof(outputHeader));
+    outputReport[41] = 0x02;
+    outputReport[44] = 0x02;
+    outputReport[46] = ledFlags[port];
+    outputReport[47] = ledColours[port][0];
+    outputReport[48] = ledColours[port][1];
+    outputReport[49] = ledColours[port][2];
+    setInitSteps(initSequence);
+
+    touchDescriptor = &touchpad;
+    imuDescriptor   = &imuSensors;
 }
 
 void DualSenseController::processReport(uint8_t *buffer, size_t length)
 {
-    // Only process the report if it's of the right type
-    if (buffer[0] != 0x31)
+    // Only process the report if it's of the right type and wasn't corrupted
+    if (buffer[0] != 0x31 || !checkInputCrc(buffer, 78))
         return;
 
     // Interpret the data as an input report
@@ -97,10 +98,14 @@ void DualSenseController::processReport(uint8_t *buffer, size_t length)
     if (report->mic)  controlData.buttons |= SCE_CTRL_EXT2;
 
     // Map the sticks
-    controlData.leftX  = report->leftX;
-    controlData.leftY  = report->leftY;
-    controlData.rightX = report->rightX;
-    controlData.rightY = report->rightY;
+    controlData.leftX  = analog8(report->leftX);
+    controlData.leftY  = analog8(report->leftY);
+    controlData.rightX = analog8(report->rightX);
+    controlData.rightY = analog8(report->rightY);
+
+    // Map the analog triggers
+    controlData.leftTrigger  = analog8(report->triggerL);
+    controlData.rightTrigger = analog8(report->triggerR);
 
     // Map the touchscreen
     touchData.touchActive[0] = !report->touch1ActiveNeg;
@@ -111,16 +116,40 @@ void DualSenseController::processReport(uint8_t *buffer, size_t length)
     touchData.touchId[1]     = report->touch2Id;
     touchData.touchX[1]      = report->touch2X;
     touchData.touchY[1]      = report->touch2Y;
+    updateTouch();
 
     // TODO: get calibration data for motion controls
 
     // Map the motion controls
-    motionState.accelerX  = report->accelerX;
-    motionState.accelerY  = report->accelerY;
-    motionState.accelerZ  = report->accelerZ;
-    motionState.velocityX = report->velocityX;
-    motionState.velocityY = report->velocityY;
-    motionState.velocityZ = report->velocityZ;
+    motionState.accel[0] = report->accelerX;
+    motionState.accel[1] = report->accelerY;
+    motionState.accel[2] = report->accelerZ;
+    motionState.gyro[0]  = report->velocityX;
+    motionState.gyro[1]  = report->velocityY;
+    motionState.gyro[2]  = report->velocityZ;
+    updateMotion();
 
     // TODO: implement battery level
 }
+
+void DualSenseController::sendInitRequest(int step)
+{
+    sendOutputReport();
+}
+
+void DualSenseController::sendOutputReport()
+{
+    // Calculate the CRC of the data (including the 0xA2 byte) and append it to the end
+    writeOutputCrc(outputReport, sizeof(outputReport), outputHeaderState, sizeof(outputHeader));
+
+    // Send the write request, omitting the 0xA2 byte
+    requestReport(HID_REQUEST_WRITE, outputReport + 1, sizeof(outputReport) - 1);
+}
+
+void DualSenseController::sendRumble(uint8_t small, uint8_t large)
+{
+    // Set the weak (right) and strong (left) motors and resend the output report
+    outputReport[5] = small;
+    outputReport[6] = large;
+    sendOutputReport();
+}
@@ -74,6 +74,13 @@ class DualSenseController: public Controller
         DualSenseController(uint32_t mac0, uint32_t mac1, int port);
 
         void processReport(uint8_t *buffer, size_t length);
+
+    private:
+        uint8_t outputReport[79] = {};
+
+        void sendInitRequest(int step);
+        void sendOutputReport();
+        void sendRumble(uint8_t small, uint8_t large);
 };
 
 #endif // DUALSENSE_CONTROLLER_H
@@ -2,18 +2,29 @@
 
 #include "dualshock3_controller.h"
 
+// Setup: a feature request that makes the controller start sending input, which is answered with a reply
+static const InitStep initSequence[] =
+{
+    { HID_REQUEST_FEATURE, 0, 200000 }
+};
+
 DualShock3Controller::DualShock3Controller(uint32_t mac0, uint32_t mac1, int port): Controller(mac0, mac1, port)
+{
+    rawMotion = true;
+    setInitSteps(initSequence);
+}
+
+void DualShock3Controller::sendInitRequest(int step)
 {
     // Prepare a feature request to make the controller functional
-    static uint8_t buffer[5] = {};
-    buffer[0] = 0xF4;
-    buffer[1] = 0x42;
-    buffer[2] = 0x03;
-    buffer[3] = 0x00;
-    buffer[4] = 0x00;
+    featureReport[0] = 0xF4;
+    featureReport[1] = 0x42;
+    featureReport[2] = 0x03;
+    featureReport[3] = 0x00;
+    featureReport[4] = 0x00;
 
     // Send the feature request
-    requestReport(HID_REQUEST_FEATURE, buffer, sizeof(buffer));
+    requestReport(HID_REQUEST_FEATURE, featureReport, sizeof(featureReport));
 }
 
 void DualShock3Controller::processReport(uint8_t *buffer, size_t length)
@@ -54,15 +65,19 @@ void DualShock3Controller::processReport(uint8_t *buffer, size_t length)
     if (report->ps)     controlData.buttons |= SCE_CTRL_PSBUTTON;
 
     // Map the sticks
-    controlData.leftX  = report->leftX;
-    controlData.leftY  = report->leftY;
-    controlData.rightX = report->rightX;
-    controlData.rightY = report->rightY;
-
-    motionState.accelerX  = report->accelerX;
-    motionState.accelerY  = report->accelerY;
-    motionState.accelerZ  = report->accelerZ;
-    motionState.velocityZ = report->velocityZ;
+    controlData.leftX  = analog8(report->leftX);
+    controlData.leftY  = analog8(report->leftY);
+    controlData.rightX = analog8(report->rightX);
+    controlData.rightY = analog8(report->rightY);
+
+    // Map the analog triggers
+    controlData.leftTrigger  = analog8(report->triggerL);
+    controlData.rightTrigger = analog8(report->triggerR);
+
+    motionState.accel[0] = report->accelerX;
+    motionState.accel[1] = report->accelerY;
+    motionState.accel[2] = report->accelerZ;
+    motionState.gyro[2]  = report->velocityZ;
 
     // TODO: implement battery level
 }
@@ -36,7 +36,12 @@ struct DualShock3Report0x01
     uint8_t rightX;
     uint8_t rightY;
 
-    uint8_t unk2[31];
+    uint8_t unk2[8];
+
+    uint8_t triggerL;
+    uint8_t triggerR;
+
+    uint8_t unk3[21];
 
     int16_t accelerX;
     int16_t accelerY;
@@ -52,6 +57,11 @@ class DualShock3Controller: public Controller
         DualShock3Controller(uint32_t mac0, uint32_t mac1, int port);
 
         void processReport(uint8_t *buffer, size_t length);
+
+    private:
+        uint8_t featureReport[5] = {};
+
+        void sendInitRequest(int step);
 };
 
 #endif // DUALSHOCK3_CONTROLLER_H
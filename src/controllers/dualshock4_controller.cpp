@@ -1,6 +1,27 @@
+#include <cstring>
 #include <psp2kern/ctrl.h>
 
 #include "dualshock4_controller.h"
+#include "../crc32.h"
+
+// Constant start of the output report, and its CRC state precomputed at compile time
+static constexpr uint8_t outputHeader[] = { 0xA2, 0x11, 0xC0, 0x20, 0xF3, 0x04, 0x00 };
+static constexpr uint32_t outputHeaderState = Crc32::updateConst(Crc32::INITIAL_STATE, outputHeader, sizeof(outputHeader));
+
+// Touchpad dimensions and dead borders
+static constexpr TouchDescriptor touchpad = makeTouchDescriptor(1920, 940, 60, 120);
+
+// Longest time assumed between touch frames in one report, in microseconds
+#define TOUCH_MAX_SPACING 8000
+
+// Motion sensor resolutions (8192 per g and 16 per degree per second), and yaw and pitch around the Y and X axes
+static constexpr ImuDescriptor imuSensors = makeImuDescriptor(8192, 16, -2, -1);
+
+// Setup: the output report that switches to extended mode, which is done once extended reports arrive
+static const InitStep initSequence[] =
+{
+    { HID_REQUEST_WRITE, 0x11, 250000 }
+};
 
 DualShock4Controller::DualShock4Controller(uint32_t mac0, uint32_t mac1, int port): Controller(mac0, mac1, port)
 {
@@ -12,39 +33,21 @@ DualShock4Controller::DualShock4Controller(uint32_t mac0, uint32_t mac1, int por
         { 0x20, 0x00, 0x20 }, // Pink
     };
 
-    // Prepare a write request to switch to extended mode and set LED colours
-    static uint8_t buffer[79] = {};
-    buffer[0]  = 0xA2;
-    buffer[1]  = 0x11;
-    buffer[2]  = 0xC0;
-    buffer[3]  = 0x20;
-    buffer[4]  = 0xF3;
-    buffer[5]  = 0x04;
-    buffer[9]  = ledColours[port][0];
-    buffer[10] = ledColours[port][1];
-    buffer[11] = ledColours[port][2];
+    // Prepare a write request to switch to extended mode and set LED colours, sent by the setup step
+    memcpy(outputReport, outputHeader, sizeof(outputHeader));
+    outputReport[9]  = ledColours[port][0];
+    outputReport[10] = ledColours[port][1];
+    outputReport[11] = ledColours[port][2];
+    setInitSteps(initSequence);
 
-    // Calculate the CRC of the data (including the 0xA2 byte) and append it to the end
-    uint32_t crc = calculateCrc(buffer, 75);
-    buffer[75] = crc >>  0;
-    buffer[76] = crc >>  8;
-    buffer[77] = crc >> 16;
-    buffer[78] = crc >> 24;
-
-    // Send the write request, omitting the 0xA2 byte
-    requestReport(HID_REQUEST_WRITE, buffer + 1, sizeof(buffer) - 1);
-
-    // Set the touchpad dimensions
-    touchData.touchWidth  = 1920;
-    touchData.touchHeight =  940;
-    touchData.touchDeadX  =   60;
-    touchData.touchDeadY  =  120;
+    touchDescriptor = &touchpad;
+    imuDescriptor   = &imuSensors;
 }
 
 void DualShock4Controller::processReport(uint8_t *buffer, size_t length)
 {
-    // Only process the report if it's of the right type
-    if (buffer[0] != 0x11)
+    // Only process the report if it's of the right type and wasn't corrupted
+    if (buffer[0] != 0x11 || !checkInputCrc(buffer, 78))
         return;
 
     // Interpret the data as an input report
@@ -86,28 +89,73 @@ void DualShock4Controller::processReport(uint8_t *buffer, size_t length)
     if (report->tpad) controlData.buttons |= SCE_CTRL_EXT1;
 
     // Map the sticks
-    controlData.leftX  = report->leftX;
-    controlData.leftY  = report->leftY;
-    controlData.rightX = report->rightX;
-    controlData.rightY = report->rightY;
-
-    // Map the touchscreen
-    touchData.touchActive[0] = !report->touch1ActiveNeg;
-    touchData.touchId[0]     = report->touch1Id;
-    touchData.touchX[0]      = report->touch1X;
-    touchData.touchY[0]      = report->touch1Y;
-    touchData.touchActive[1] = !report->touch2ActiveNeg;
-    touchData.touchId[1]     = report->touch2Id;
-    touchData.touchX[1]      = report->touch2X;
-    touchData.touchY[1]      = report->touch2Y;
+    controlData.leftX  = analog8(report->leftX);
+    controlData.leftY  = analog8(report->leftY);
+    controlData.rightX = analog8(report->rightX);
+    controlData.rightY = analog8(report->rightY);
+
+    // Map the analog triggers
+    controlData.leftTrigger  = analog8(report->triggerL);
+    controlData.rightTrigger = analog8(report->triggerR);
+
+    // Map the touchscreen; touches can be sampled faster than reports are sent, so a report can hold several frames
+    int packets = (report->touchPackets < 1) ? 1 : (report->touchPackets > 4) ? 4 : report->touchPackets;
+    uint64_t spacing = (reportTime - touchTime) / packets;
+    if (spacing > TOUCH_MAX_SPACING)
+        spacing = TOUCH_MAX_SPACING;
+
+    for (int i = 0; i < packets; i++)
+    {
+        // Frames are oldest first, and one that was already queued can be repeated in the next report
+        const DualShock4TouchPacket &packet = report->touch[i];
+        if (touchTime && packet.timestamp == touchTimestamp)
+            continue;
+
+        touchData.touchActive[0] = !packet.touch1ActiveNeg;
+        touchData.touchId[0]     = packet.touch1Id;
+        touchData.touchX[0]      = packet.touch1X;
+        touchData.touchY[0]      = packet.touch1Y;
+        touchData.touchActive[1] = !packet.touch2ActiveNeg;
+        touchData.touchId[1]     = packet.touch2Id;
+        touchData.touchX[1]      = packet.touch2X;
+        touchData.touchY[1]      = packet.touch2Y;
+
+        // Spread the frames out over the time since the last one
+        touchTimestamp = packet.timestamp;
+        touchTime = reportTime - (packets - 1 - i) * spacing;
+        updateTouch(touchTime);
+    }
 
     // Map the motion controls
-    motionState.accelerX  = report->accelerX;
-    motionState.accelerY  = report->accelerY;
-    motionState.accelerZ  = report->accelerZ;
-    motionState.velocityX = report->velocityX;
-    motionState.velocityY = report->velocityY;
-    motionState.velocityZ = report->velocityZ;
+    motionState.accel[0] = report->accelerX;
+    motionState.accel[1] = report->accelerY;
+    motionState.accel[2] = report->accelerZ;
+    motionState.gyro[0]  = report->velocityX;
+    motionState.gyro[1]  = report->velocityY;
+    motionState.gyro[2]  = report->velocityZ;
+    updateMotion();
 
     // TODO: implement battery level
 }
+
+void DualShock4Controller::sendInitRequest(int step)
+{
+    sendOutputReport();
+}
+
+void DualShock4Controller::sendOutputReport()
+{
+    // Calculate the CRC of the data (including the 0xA2 byte) and append it to the end
+    writeOutputCrc(outputReport, sizeof(outputReport), outputHeaderState, sizeof(outputHeader));
+
+    // Send the write request, omitting the 0xA2 byte
+    requestReport(HID_REQUEST_WRITE, outputReport + 1, sizeof(outputReport) - 1);
+}
+
+void DualShock4Controller::sendRumble(uint8_t small, uint8_t large)
+{
+    // Set the weak (right) and strong (left) motors and resend the output report
+    outputReport[7] = small;
+    outputReport[8] = large;
+    sendOutputReport();
+}
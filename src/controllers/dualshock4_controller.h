@@ -3,6 +3,22 @@
 
 #include "../controller.h"
 
+struct DualShock4TouchPacket
+{
+    uint8_t timestamp;
+
+    unsigned int touch1Id        : 7;
+    unsigned int touch1ActiveNeg : 1;
+    unsigned int touch1X         : 12;
+    unsigned int touch1Y         : 12;
+
+    unsigned int touch2Id        : 7;
+    unsigned int touch2ActiveNeg : 1;
+    unsigned int touch2X         : 12;
+    unsigned int touch2Y         : 12;
+}
+__attribute__((packed));
+
 struct DualShock4Report0x11
 {
     uint8_t reportId;
@@ -53,17 +69,10 @@ struct DualShock4Report0x11
     uint8_t microphone   : 1;
     uint8_t              : 0;
 
-    uint8_t unk1[4];
+    uint8_t unk1[2];
 
-    unsigned int touch1Id        : 7;
-    unsigned int touch1ActiveNeg : 1;
-    unsigned int touch1X         : 12;
-    unsigned int touch1Y         : 12;
-
-    unsigned int touch2Id        : 7;
-    unsigned int touch2ActiveNeg : 1;
-    unsigned int touch2X         : 12;
-    unsigned int touch2Y         : 12;
+    uint8_t touchPackets;
+    DualShock4TouchPacket touch[4];
 }
 __attribute__((packed));
 
@@ -73,6 +82,17 @@ class DualShock4Controller: public Controller
         DualShock4Controller(uint32_t mac0, uint32_t mac1, int port);
 
         void processReport(uint8_t *buffer, size_t length);
+
+    private:
+        uint8_t outputReport[79] = {};
+
+        // Timestamp and time of the last queued touch frame
+        uint8_t touchTimestamp = 0;
+        uint64_t touchTime = 0;
+
+        void sendInitRequest(int step);
+        void sendOutputReport();
+        void sendRumble(uint8_t small, uint8_t large);
 };
 
 #endif // DUALSHOCK4_CONTROLLER_H
@@ -70,9 +70,9 @@ void EightBitDoLite2Controller::processReport(uint8_t *buffer, size_t length)
     // Empirically, the left stick axes bytes are b4 (X) and b5 (Y). Our previous
     // implementation swapped them, resulting in a 90° rotation (Up->Right, etc).
     // Map directly; if any axis is still inverted on-device, we can invert just that axis.
-    controlData.leftX  = buffer[4];
-    controlData.leftY  = buffer[5];
-    controlData.rightX = buffer[6];
-    controlData.rightY = buffer[7];
+    controlData.leftX  = analog8(buffer[4]);
+    controlData.leftY  = analog8(buffer[5]);
+    controlData.rightX = analog8(buffer[6]);
+    controlData.rightY = analog8(buffer[7]);
 }
 
@@ -1,20 +1,67 @@
+#include <cstring>
 #include <psp2kern/ctrl.h>
 
 #include "switch_pro_controller.h"
+#include "switch_rumble.h"
 
-// Inline deadzone helper for Pro 3 analog sticks
-static inline uint8_t applyDeadzone(uint8_t v, uint8_t center, uint8_t dz)
+// Motion sensor resolutions (4096 per g and 0.07 degrees per second per step), and yaw and pitch around Z and Y
+static constexpr ImuDescriptor imuSensors = makeImuDescriptor(4096, 1 / 0.07, -3, -2);
+
+// Per-axis deadzone of 8BitDo Pro 3 sticks, in steps of the system's 8 bits from the centre, which hides their jitter
+// at rest; it applies on top of the shared stick shaping
+#define PRO3_DEADZONE 3
+
+static inline uint16_t applyDeadzone(uint16_t value)
 {
-    int d = (int)v - (int)center;
-    if (d < 0) d = -d;
-    return (d <= dz) ? center : v;
+    int distance = (value >> 8) - 0x80;
+    return (distance >= -PRO3_DEADZONE && distance <= PRO3_DEADZONE) ? 0x8000 : value;
 }
 
+// Time between motion samples and ticks of the report timer, and how far the timer may drift behind the reports before
+// it's resynchronized, in microseconds
+#define IMU_FRAME_INTERVAL 5000
+#define IMU_MAX_DRIFT      50000
+
+// Setup: wait for the first report to see which mode the controller starts in, then request standard mode (answered by
+// standard 0x30 reports) if it still needs it
+static const InitStep initSequence[] =
+{
+    { HID_REQUEST_READ,  0,    250000 },
+    { HID_REQUEST_WRITE, 0x30, 250000 }
+};
+
 SwitchProController::SwitchProController(uint32_t mac0, uint32_t mac1, int port): Controller(mac0, mac1, port)
 {
-    // Don't send any mode-switching writes here.
-    // Some Switch-compatible controllers (e.g. 8BitDo Pro 3) can disconnect if we send the
-    // "standard mode 0x30" command immediately on connect. We defer until we see input.
+    imuDescriptor = &imuSensors;
+    setInitSteps(initSequence);
+
+    // The report mode seen on earlier connections is remembered, so a controller that's known to support standard
+    // mode gets it even if it starts out sending 0x3F reports.
+    knownMode = getCachedMode();
+}
+
+bool SwitchProController::needsInitStep(int step)
+{
+    // Don't request standard mode right away, or for 0x3F reports (8BitDo Pro 3 mapping) since it already works there.
+    // Some Switch-compatible controllers (e.g. 8BitDo Pro 3) can disconnect if we send the "standard mode 0x30"
+    // command immediately on connect, so it's only sent once input was seen, or if this controller has sent standard
+    // reports on an earlier connection.
+    if (step == 0)
+        return true;
+    if (firstReport == 0x30)
+        return false;
+    if (knownMode == 0x30)
+        return true;
+    return firstReport && firstReport != 0x3F;
+}
+
+void SwitchProController::sendInitRequest(int step)
+{
+    modeReport[0]  = 0x01;
+    modeReport[1]  = 0x01;
+    modeReport[10] = 0x03;
+    modeReport[11] = 0x30;
+    requestReport(HID_REQUEST_WRITE, modeReport, sizeof(modeReport));
 }
 
 void SwitchProController::processReport(uint8_t *buffer, size_t length)
@@ -22,25 +69,21 @@ void SwitchProController::processReport(uint8_t *buffer, size_t length)
     if (length < 12)
         return;
 
-    // If the device is not already sending standard reports, request standard mode once.
-    // IMPORTANT: do NOT do this for 0x3F (8BitDo Pro 3 mapping) since it already works there.
-    if (!requestedStandardMode && buffer[0] != 0x30 && buffer[0] != 0x3F)
-    {
-        static uint8_t report[12] = {};
-        report[0]  = 0x01;
-        report[1]  = 0x01;
-        report[10] = 0x03;
-        report[11] = 0x30;
-        requestReport(HID_REQUEST_WRITE, report, sizeof(report));
-        requestedStandardMode = true;
-        // Continue; this report likely isn't useful anyway.
-        return;
-    }
+    // Keep the mode the controller started in for the setup
+    if (!firstReport)
+        firstReport = buffer[0];
 
     // 8BitDo Pro 3 (in Switch-compatible mode) can present with the same VID/PID as Switch Pro
     // but uses a different input report (0x3F). Handle it here.
     if (buffer[0] == 0x3F)
     {
+        // Remember this as the controller's mode, unless it's been seen in standard mode before
+        if (!knownMode)
+        {
+            knownMode = 0x3F;
+            setCachedMode(knownMode);
+        }
+
         // Byte layout derived from vitacontrol_mapper_results.txt:
         //  b1=buf[1] face+shoulders+triggers (bitfield)
         //  b2=buf[2] select/start/home (bitfield)
@@ -94,18 +137,13 @@ void SwitchProController::processReport(uint8_t *buffer, size_t length)
         //   RY = b10 | (b11 << 8)
         //
         // At rest these MSBs sit around 0x80 (center), matching Vita expectations.
-        // We use only the MSB (high byte) as it's stable; the LSB has jitter.
-        // Direct MSB reads avoid unnecessary 16-bit construction and shifting.
-        const uint8_t lx = buffer[5];   // MSB of LX
-        const uint8_t ly = buffer[7];   // MSB of LY
-        const uint8_t rx = buffer[9];   // MSB of RX
-        const uint8_t ry = buffer[11];  // MSB of RY
-
-        const uint8_t dz = 3;
-        controlData.leftX  = applyDeadzone(lx, 0x80, dz);
-        controlData.leftY  = applyDeadzone(ly, 0x80, dz);
-        controlData.rightX = applyDeadzone(rx, 0x80, dz);
-        controlData.rightY = applyDeadzone(ry, 0x80, dz);
+        // The LSB has jitter, but the full value is kept so the shared stick shaping works with all of its
+        // precision, and it's only reduced to 8 bits when passed to the system. Sticks near the centre are
+        // snapped to it, as they always have been for this controller.
+        controlData.leftX  = applyDeadzone(buffer[4]  | (buffer[5]  << 8));
+        controlData.leftY  = applyDeadzone(buffer[6]  | (buffer[7]  << 8));
+        controlData.rightX = applyDeadzone(buffer[8]  | (buffer[9]  << 8));
+        controlData.rightY = applyDeadzone(buffer[10] | (buffer[11] << 8));
 
         // NOTE: L3/R3 click bits weren't cleanly isolated in the captures (axis bytes changed too),
         // so we don't map stick clicks yet to avoid false positives. We can add them after one more
@@ -121,6 +159,12 @@ void SwitchProController::processReport(uint8_t *buffer, size_t length)
         return;
     }
 
+    if (knownMode != 0x30)
+    {
+        knownMode = 0x30;
+        setCachedMode(knownMode);
+    }
+
     // Interpret the data as an input report
     SwitchProReport0x30 *report = (SwitchProReport0x30*)buffer;
 
@@ -155,23 +199,68 @@ void SwitchProController::processReport(uint8_t *buffer, size_t length)
     // Map the extra buttons
     if (report->capture) controlData.buttons |= SCE_CTRL_EXT1;
 
-    // Map the sticks
-    controlData.leftX  = report->leftX  >> 4;
-    controlData.leftY  = report->leftY  >> 4;
-    controlData.rightX = report->rightX >> 4;
-    controlData.rightY = report->rightY >> 4;
+    // Map the sticks, which have 12 bits
+    controlData.leftX  = analog12(report->leftX);
+    controlData.leftY  = analog12(report->leftY);
+    controlData.rightX = analog12(report->rightX);
+    controlData.rightY = analog12(report->rightY);
 
     // Reverse up and down
-    controlData.leftY  = 255 - controlData.leftY;
-    controlData.rightY = 255 - controlData.rightY;
+    controlData.leftY  = 0xFFFF - controlData.leftY;
+    controlData.rightY = 0xFFFF - controlData.rightY;
 
-    // Map the motion controls
-    motionState.accelerX  = report->accelerX;
-    motionState.accelerY  = report->accelerY;
-    motionState.accelerZ  = report->accelerZ;
-    motionState.velocityX = report->velocityX;
-    motionState.velocityY = report->velocityY;
-    motionState.velocityZ = report->velocityZ;
+    // Map the motion controls, fusing all three samples so fast movements aren't missed, with the last one kept as the
+    // current state
+    uint64_t lastTime = imuTime;
+    uint64_t time = getImuTime(report->timer);
+    for (int i = 0; i < 3; i++)
+    {
+        const SwitchProImuFrame &frame = report->imu[i];
+        motionState.accel[0] = frame.accelerX;
+        motionState.accel[1] = frame.accelerY;
+        motionState.accel[2] = frame.accelerZ;
+        motionState.gyro[0]  = frame.velocityX;
+        motionState.gyro[1]  = frame.velocityY;
+        motionState.gyro[2]  = frame.velocityZ;
+
+        // Keep timestamps in order if the timer was just resynchronized
+        uint64_t frameTime = time - (2 - i) * IMU_FRAME_INTERVAL;
+        updateMotion((frameTime > lastTime) ? frameTime : lastTime);
+    }
 
     // TODO: implement battery level
 }
+
+uint64_t SwitchProController::getImuTime(uint8_t timer)
+{
+    // Advance by the timer ticks since the last report, which follow the controller's clock rather than radio delays
+    uint8_t ticks = timer - imuTimer;
+    imuTimer = timer;
+    imuTime += ticks * IMU_FRAME_INTERVAL;
+
+    // Samples can't be newer than the report that carries them, and start over from it after a long gap
+    if (imuTime > reportTime || reportTime - imuTime > IMU_MAX_DRIFT)
+        imuTime = reportTime;
+    return imuTime;
+}
+
+void SwitchProController::sendRumble(uint8_t small, uint8_t large)
+{
+    // Encode the motor values only if they changed since the last request
+    uint16_t key = (large << 8) | small;
+    if (key != rumbleKey)
+    {
+        SwitchRumble::encode(small, large, rumbleData);
+        rumbleKey = key;
+    }
+
+    // Prepare a rumble-only output report using the same data for the left and right motors,
+    // with a counter that increments for every report
+    rumbleReport[0] = 0x10;
+    rumbleReport[1] = rumbleCounter++ & 0x0F;
+    memcpy(&rumbleReport[2], rumbleData, sizeof(rumbleData));
+    memcpy(&rumbleReport[6], rumbleData, sizeof(rumbleData));
+
+    // Send the write request
+    requestReport(HID_REQUEST_WRITE, rumbleReport, sizeof(rumbleReport));
+}
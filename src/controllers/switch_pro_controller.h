@@ -3,6 +3,18 @@
 
 #include "../controller.h"
 
+struct SwitchProImuFrame
+{
+    int16_t accelerX;
+    int16_t accelerY;
+    int16_t accelerZ;
+
+    int16_t velocityX;
+    int16_t velocityY;
+    int16_t velocityZ;
+}
+__attribute__((packed));
+
 struct SwitchProReport0x30
 {
     uint8_t reportId;
@@ -42,13 +54,8 @@ struct SwitchProReport0x30
 
     uint8_t vibrator;
 
-    uint16_t accelerX;
-    uint16_t accelerY;
-    uint16_t accelerZ;
-
-    uint16_t velocityX;
-    uint16_t velocityY;
-    uint16_t velocityZ;
+    // Three motion samples taken 5ms apart, oldest first
+    SwitchProImuFrame imu[3];
 }
 __attribute__((packed));
 
@@ -60,7 +67,24 @@ class SwitchProController: public Controller
         void processReport(uint8_t *buffer, size_t length);
 
     private:
-        bool requestedStandardMode = false;
+        uint8_t firstReport = 0;
+        uint8_t knownMode = 0;
+        uint8_t modeReport[12] = {};
+
+        // Report timer and time of the newest motion sample, for timestamping each sample in a report
+        uint8_t imuTimer = 0;
+        uint64_t imuTime = 0;
+        uint8_t rumbleReport[10] = {};
+        uint8_t rumbleCounter = 0;
+
+        // Encoded data for the last requested motor values (neutral by default)
+        uint16_t rumbleKey = 0;
+        uint8_t rumbleData[4] = { 0x00, 0x01, 0x40, 0x40 };
+
+        uint64_t getImuTime(uint8_t timer);
+        bool needsInitStep(int step);
+        void sendInitRequest(int step);
+        void sendRumble(uint8_t small, uint8_t large);
 };
 
 #endif // SWITCH_PRO_CONTROLLER_H
@@ -0,0 +1,60 @@
+#include "switch_rumble.h"
+
+// Encode an 8-bit motor value as an HD rumble amplitude (0-100), using the piecewise log2 curve of the controller
+static constexpr uint8_t encodeAmplitude(uint32_t value)
+{
+    // Amplitude 0 is off, and everything below ~12% is close enough to linear
+    if (value == 0)
+        return 0;
+    if (value <= 30)
+        return (value * 16 + 15) / 30;
+
+    // Work in log2 of the value scaled to 0-1, so round(log2(amp * k) * s) becomes a sum of fixed-point logs
+    int32_t amp = SwitchRumble::log2Fixed(value << 16) - SwitchRumble::log2Fixed(255 << 16);
+    int32_t encoded = 0;
+
+    if (value <= 58) // Up to ~23%: round(log2(amp * 17) * 16)
+        encoded = (16 * (amp + SwitchRumble::log2Fixed(17 << 16)) + (1 << 15)) >> 16;
+    else // Above that: round(log2(amp * 8.7) * 32)
+        encoded = (32 * (amp + SwitchRumble::log2Fixed(87 << 16) - SwitchRumble::log2Fixed(10 << 16)) + (1 << 15)) >> 16;
+
+    return (encoded > 100) ? 100 : encoded;
+}
+
+struct RumbleTables
+{
+    uint16_t high[256];
+    uint16_t low[256];
+
+    constexpr RumbleTables(): high(), low()
+    {
+        // The high band frequency is stored as (encoded - 0x60) * 4 and the low band one as encoded - 0x40
+        const uint16_t highFreq = (SwitchRumble::encodeFrequency(SwitchRumble::HIGH_BAND_HZ) - 0x60) * 4;
+        const uint8_t lowFreq = SwitchRumble::encodeFrequency(SwitchRumble::LOW_BAND_HZ) - 0x40;
+
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint8_t amp = encodeAmplitude(i);
+
+            // High band: frequency low byte, then amplitude * 2 plus the frequency high bit
+            high[i] = (highFreq & 0xFF) | (((amp << 1) + (highFreq >> 8)) << 8);
+
+            // Low band: frequency plus the amplitude low bit, then 0x40 + amplitude / 2
+            low[i] = (lowFreq | ((amp & 1) << 7)) | ((0x40 + (amp >> 1)) << 8);
+        }
+    }
+};
+
+// Generated at compile time so encoding is a pair of table loads with no floating point
+static constexpr RumbleTables tables;
+
+void SwitchRumble::encode(uint8_t small, uint8_t large, uint8_t *data)
+{
+    // Look up both bands and store them in report byte order
+    uint16_t high = tables.high[small];
+    uint16_t low  = tables.low[large];
+    data[0] = high >> 0;
+    data[1] = high >> 8;
+    data[2] = low  >> 0;
+    data[3] = low  >> 8;
+}
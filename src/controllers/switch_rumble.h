@@ -0,0 +1,48 @@
+#ifndef SWITCH_RUMBLE_H
+#define SWITCH_RUMBLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace SwitchRumble
+{
+
+// Frequencies used for the small (high band) and large (low band) motor values
+static const uint32_t HIGH_BAND_HZ = 320;
+static const uint32_t LOW_BAND_HZ  = 160;
+
+// Calculate log2 of a 16.16 fixed-point value, returning 16.16 fixed point (compile-time use)
+constexpr int32_t log2Fixed(uint64_t value)
+{
+    int32_t result = 0;
+
+    // Normalize the value to [1, 2) to get the integer part
+    while (value >= (2 << 16)) { value >>= 1; result += 1 << 16; }
+    while (value <  (1 << 16)) { value <<= 1; result -= 1 << 16; }
+
+    // Square the value repeatedly to get the fractional bits one at a time
+    for (int i = 15; i >= 0; i--)
+    {
+        value = (value * value) >> 16;
+        if (value >= (2 << 16))
+        {
+            value >>= 1;
+            result += 1 << i;
+        }
+    }
+
+    return result;
+}
+
+// Encode a frequency in Hz as round(log2(hz / 10) * 32) (compile-time use)
+constexpr uint8_t encodeFrequency(uint32_t hz)
+{
+    return (32 * (log2Fixed((uint64_t)hz << 16) - log2Fixed(10 << 16)) + (1 << 15)) >> 16;
+}
+
+// Encode an 8-bit motor value into the pair of HD rumble bytes for each band
+void encode(uint8_t small, uint8_t large, uint8_t *data);
+
+};
+
+#endif // SWITCH_RUMBLE_H
@@ -2,11 +2,20 @@
 
 #include "xbox_one_controller_2016.h"
 
+// Setup: an empty write request, just to receive a response
+static const InitStep initSequence[] =
+{
+    { HID_REQUEST_WRITE, 0, 200000 }
+};
+
 XboxOneController2016::XboxOneController2016(uint32_t mac0, uint32_t mac1, int port): Controller(mac0, mac1, port)
 {
-    // Send an empty write request just to receive a response
-    static uint8_t report[4] = {};
-    requestReport(HID_REQUEST_WRITE, report, sizeof(report));
+    setInitSteps(initSequence);
+}
+
+void XboxOneController2016::sendInitRequest(int step)
+{
+    requestReport(HID_REQUEST_WRITE, emptyReport, sizeof(emptyReport));
 }
 
 void XboxOneController2016::processReport(uint8_t *buffer, size_t length)
@@ -53,10 +62,31 @@ void XboxOneController2016::processReport(uint8_t *buffer, size_t length)
     // if (report->guide) controlData.buttons |= SCE_CTRL_PSBUTTON;
 
     // Map the sticks
-    controlData.leftX  = report->leftX  >> 8;
-    controlData.leftY  = report->leftY  >> 8;
-    controlData.rightX = report->rightX >> 8;
-    controlData.rightY = report->rightY >> 8;
+    controlData.leftX  = report->leftX;
+    controlData.leftY  = report->leftY;
+    controlData.rightX = report->rightX;
+    controlData.rightY = report->rightY;
+
+    // Map the analog triggers, which have 10 bits
+    controlData.leftTrigger  = analog10(report->triggerL & 0x3FF);
+    controlData.rightTrigger = analog10(report->triggerR & 0x3FF);
 
     // TODO: implement battery level
 }
+
+void XboxOneController2016::sendRumble(uint8_t small, uint8_t large)
+{
+    // Prepare a rumble report, enabling all motors with the main motors scaled to the 0-100 range
+    rumbleReport[0] = 0x03;
+    rumbleReport[1] = 0x0F;
+    rumbleReport[2] = 0x00; // Left trigger
+    rumbleReport[3] = 0x00; // Right trigger
+    rumbleReport[4] = large * 100 / 255;
+    rumbleReport[5] = small * 100 / 255;
+    rumbleReport[6] = 0xFF; // Duration
+    rumbleReport[7] = 0x00; // Delay
+    rumbleReport[8] = 0x00; // Repeat count
+
+    // Send the write request
+    requestReport(HID_REQUEST_WRITE, rumbleReport, sizeof(rumbleReport));
+}
@@ -45,6 +45,13 @@ class XboxOneController2016: public Controller
         XboxOneController2016(uint32_t mac0, uint32_t mac1, int port);
 
         void processReport(uint8_t *buffer, size_t length);
+
+    private:
+        uint8_t emptyReport[4] = {};
+        uint8_t rumbleReport[9] = {};
+
+        void sendInitRequest(int step);
+        void sendRumble(uint8_t small, uint8_t large);
 };
 
 #endif // XBOX_ONE_CONTROLLER_2016_H
@@ -0,0 +1,44 @@
+#include "crc32.h"
+
+struct CrcTables
+{
+    uint32_t data[4][256];
+
+    constexpr CrcTables(): data()
+    {
+        // Build the standard byte table, then derive the tables for the 3 following bytes of a word
+        for (size_t i = 0; i < 256; i++)
+        {
+            uint8_t value = i;
+            data[0][i] = Crc32::updateConst(0, &value, 1);
+        }
+
+        for (size_t i = 0; i < 256; i++)
+        {
+            for (size_t j = 1; j < 4; j++)
+                data[j][i] = (data[j - 1][i] >> 8) ^ data[0][data[j - 1][i] & 0xFF];
+        }
+    }
+};
+
+// Generated at compile time so it lives in read-only data and needs no init at module start
+static constexpr CrcTables tables;
+
+uint32_t Crc32::update(uint32_t state, const uint8_t *data, size_t length)
+{
+    // Process a 32-bit word per step (slice-by-4); bytes are assembled manually so data needs no alignment
+    while (length >= 4)
+    {
+        state ^= (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        state = tables.data[3][(state >>  0) & 0xFF] ^ tables.data[2][(state >>  8) & 0xFF] ^
+                tables.data[1][(state >> 16) & 0xFF] ^ tables.data[0][(state >> 24) & 0xFF];
+        data   += 4;
+        length -= 4;
+    }
+
+    // Process any leftover bytes one at a time
+    while (length--)
+        state = (state >> 8) ^ tables.data[0][(state ^ *data++) & 0xFF];
+
+    return state;
+}
@@ -0,0 +1,41 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Crc32
+{
+
+// CRC state before any data has been added
+static const uint32_t INITIAL_STATE = 0xFFFFFFFF;
+
+// Advance a CRC state bit by bit; only meant for compile-time use, like precomputing constant report headers
+constexpr uint32_t updateConst(uint32_t state, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        state ^= data[i];
+        for (size_t j = 0; j < 8; j++)
+            state = (state >> 1) ^ ((state & 1) ? 0xEDB88320 : 0);
+    }
+    return state;
+}
+
+// Advance a CRC state using the sliced lookup tables, so a state saved after a prefix can be resumed
+uint32_t update(uint32_t state, const uint8_t *data, size_t length);
+
+// Convert a CRC state into the final CRC value
+inline uint32_t finish(uint32_t state)
+{
+    return ~state;
+}
+
+inline uint32_t calculate(const uint8_t *data, size_t length)
+{
+    return finish(update(INITIAL_STATE, data, length));
+}
+
+};
+
+#endif // CRC32_H
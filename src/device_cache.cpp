@@ -0,0 +1,170 @@
+#include <cstring>
+#include <psp2kern/bt.h>
+#include <psp2kern/io/fcntl.h>
+
+#include "device_cache.h"
+#include "log.h"
+
+// File header, changed whenever the layout of entries does so old files are ignored
+#define CACHE_MAGIC   0x43444356 // "VCDC"
+#define CACHE_VERSION 1
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+};
+
+static DeviceInfo entries[DEVICE_CACHE_SIZE];
+static uint32_t entryCount = 0;
+static uint32_t useCounter = 0;
+static bool dirty = false;
+
+static DeviceInfo *findEntry(uint32_t mac0, uint32_t mac1)
+{
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        if (entries[i].mac0 == mac0 && entries[i].mac1 == mac1)
+            return &entries[i];
+    }
+    return nullptr;
+}
+
+void DeviceCache::load()
+{
+    SceUID fd = ksceIoOpen(DEVICE_CACHE_PATH, SCE_O_RDONLY, 0);
+    if (fd < 0)
+        return;
+
+    // Take as many entries as the file has, as long as it's the current version
+    CacheHeader header;
+    if (ksceIoRead(fd, &header, sizeof(header)) == sizeof(header) && header.magic == CACHE_MAGIC &&
+        header.version == CACHE_VERSION && header.count <= DEVICE_CACHE_SIZE)
+    {
+        int size = header.count * sizeof(DeviceInfo);
+        if (ksceIoRead(fd, entries, size) == size)
+            entryCount = header.count;
+    }
+    ksceIoClose(fd);
+
+    // Carry on counting uses from the most recent one
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        if (entries[i].lastUse > useCounter)
+            useCounter = entries[i].lastUse;
+    }
+
+    LOG_INFO(LOG_CORE, "Loaded %d cached devices from %s\n", entryCount, DEVICE_CACHE_PATH);
+}
+
+void DeviceCache::save()
+{
+    dirty = false;
+    SceUID fd = ksceIoOpen(DEVICE_CACHE_PATH, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        LOG_WARN(LOG_CORE, "Failed to save device cache: 0x%08X\n", fd);
+        return;
+    }
+
+    CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, entryCount };
+    ksceIoWrite(fd, &header, sizeof(header));
+    ksceIoWrite(fd, entries, entryCount * sizeof(DeviceInfo));
+    ksceIoClose(fd);
+}
+
+bool DeviceCache::isDirty()
+{
+    return dirty;
+}
+
+const DeviceInfo *DeviceCache::find(uint32_t mac0, uint32_t mac1)
+{
+    // Lookups happen when a device connects, so they also count as uses (kept in memory only, until the next save)
+    DeviceInfo *entry = findEntry(mac0, mac1);
+    if (entry)
+        entry->lastUse = ++useCounter;
+    return entry;
+}
+
+static void add(uint32_t mac0, uint32_t mac1, uint16_t vid, uint16_t pid)
+{
+    DeviceInfo *entry = findEntry(mac0, mac1);
+    if (!entry)
+    {
+        // Use a free entry, or replace the one used least recently
+        if (entryCount < DEVICE_CACHE_SIZE)
+        {
+            entry = &entries[entryCount++];
+        }
+        else
+        {
+            entry = &entries[0];
+            for (uint32_t i = 1; i < entryCount; i++)
+            {
+                if (entries[i].lastUse < entry->lastUse)
+                    entry = &entries[i];
+            }
+        }
+        memset(entry, 0, sizeof(DeviceInfo));
+        entry->mac0 = mac0;
+        entry->mac1 = mac1;
+    }
+    else if (entry->vid == vid && entry->pid == pid)
+    {
+        return;
+    }
+
+    // A device that came back as something else starts over with an unknown mode
+    entry->vid = vid;
+    entry->pid = pid;
+    entry->mode = 0;
+    entry->lastUse = ++useCounter;
+    dirty = true;
+}
+
+bool DeviceCache::getVidPid(uint32_t mac0, uint32_t mac1, uint16_t *id)
+{
+    // Devices seen before don't need to be asked again; returns whether the cache had it
+    const DeviceInfo *info = find(mac0, mac1);
+    if (info)
+    {
+        id[0] = info->vid;
+        id[1] = info->pid;
+        return true;
+    }
+
+    // Only cache what the device actually answered; a failed query leaves an ID no driver matches
+    int ret = ksceBtGetVidPid(mac0, mac1, id);
+    if (ret < 0)
+    {
+        LOG_WARN(LOG_DRIVER, "  Failed to get VID:PID: 0x%08X\n", ret);
+        id[0] = id[1] = 0;
+        return false;
+    }
+
+    add(mac0, mac1, id[0], id[1]);
+    return false;
+}
+
+void DeviceCache::setMode(uint32_t mac0, uint32_t mac1, uint8_t mode)
+{
+    DeviceInfo *entry = findEntry(mac0, mac1);
+    if (entry && entry->mode != mode)
+    {
+        entry->mode = mode;
+        dirty = true;
+    }
+}
+
+void DeviceCache::remove(uint32_t mac0, uint32_t mac1)
+{
+    // Move the last entry into the removed one's place
+    DeviceInfo *entry = findEntry(mac0, mac1);
+    if (entry)
+    {
+        *entry = entries[--entryCount];
+        dirty = true;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef DEVICE_CACHE_H
+#define DEVICE_CACHE_H
+
+#include <stdint.h>
+
+// File the cache is kept in between boots, next to the settings
+#define DEVICE_CACHE_PATH "ur0:tai/vitacontrol_devices.bin"
+
+// Devices remembered; the one used least recently is forgotten to make room for a new one
+#define DEVICE_CACHE_SIZE 16
+
+// What's known about a device from earlier connections: its VID and PID, which pick the driver, and the report mode
+// the driver last saw it use (0 if unknown), so setup steps it doesn't need can be skipped
+struct DeviceInfo
+{
+    uint32_t mac0;
+    uint32_t mac1;
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t mode;
+    uint8_t reserved[3];
+    uint32_t lastUse;
+};
+
+// Per-device cache, loaded once when the plugin starts. It's only touched from the bluetooth callback thread, which
+// also writes it back to the file between events whenever it changes.
+namespace DeviceCache
+{
+
+void load();
+void save();
+bool isDirty();
+
+const DeviceInfo *find(uint32_t mac0, uint32_t mac1);
+bool getVidPid(uint32_t mac0, uint32_t mac1, uint16_t *id);
+void setMode(uint32_t mac0, uint32_t mac1, uint8_t mode);
+void remove(uint32_t mac0, uint32_t mac1);
+
+};
+
+#endif // DEVICE_CACHE_H
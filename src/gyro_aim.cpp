@@ -0,0 +1,148 @@
+#include <cstring>
+
+#include "config.h"
+#include "gyro_aim.h"
+
+// Stick deflection is centred, with full deflection at 128 << 8
+#define AXIS_FULL (128 << 8)
+
+// Rotation rates of the sensitivity and acceleration settings, in rad/s with IMU_SHIFT fractional bits
+// (100 and 360 degrees per second)
+#define SENSITIVITY_RATE  114382
+#define ACCELERATION_RATE 411775
+
+// Rotation rate of one degree per second, for the deadband
+#define DEGREE_RATE 1144
+
+// Built-in settings, used for anything the config file doesn't set
+#define DEFAULT_SENSITIVITY  100
+#define DEFAULT_ACCELERATION 0
+#define DEFAULT_DEADBAND     2
+
+struct AimSettings
+{
+    int enabled;
+    int sensitivity;
+    int acceleration;
+    int deadband;
+    int invert[2];
+    uint32_t ratchet;
+};
+
+static AimSettings settings[MAX_PORTS];
+
+void GyroAim::reset()
+{
+    for (int i = 0; i < MAX_PORTS; i++)
+    {
+        AimSettings &s = settings[i];
+        s.enabled      = 0;
+        s.sensitivity  = DEFAULT_SENSITIVITY;
+        s.acceleration = DEFAULT_ACCELERATION;
+        s.deadband     = DEFAULT_DEADBAND;
+        s.invert[0]    = 0;
+        s.invert[1]    = 0;
+        s.ratchet      = 0;
+    }
+}
+
+static bool setPortOption(AimSettings &s, const char *key, const char *value)
+{
+    // The ratchet is a button that pauses aiming while held, to re-centre the controller like lifting a mouse
+    if (strcmp(key, "ratchet") == 0)
+        return Config::parseButtons(value, &s.ratchet);
+
+    int number;
+    if (!Config::parseInt(value, &number) || number < 0)
+        return false;
+
+    if (strcmp(key, "enabled") == 0 && number <= 1)
+        s.enabled = number;
+    else if (strcmp(key, "sensitivity") == 0 && number <= 1000)
+        s.sensitivity = number;
+    else if (strcmp(key, "acceleration") == 0 && number <= 1000)
+        s.acceleration = number;
+    else if (strcmp(key, "deadband") == 0 && number <= 100)
+        s.deadband = number;
+    else if (strcmp(key, "invert_x") == 0 && number <= 1)
+        s.invert[0] = number;
+    else if (strcmp(key, "invert_y") == 0 && number <= 1)
+        s.invert[1] = number;
+    else
+        return false;
+    return true;
+}
+
+bool GyroAim::setOption(const char *port, const char *key, const char *value)
+{
+    // "[gyro]" applies to every port, and "[gyro N]" only to controller N (1-4)
+    if (!*port)
+    {
+        for (int i = 0; i < MAX_PORTS; i++)
+        {
+            if (!setPortOption(settings[i], key, value))
+                return false;
+        }
+        return true;
+    }
+
+    int index;
+    if (!Config::parseInt(port, &index) || index < 1 || index > MAX_PORTS)
+        return false;
+    return setPortOption(settings[index - 1], key, value);
+}
+
+void GyroAim::compile(int port, AimTables &t)
+{
+    const AimSettings &s = settings[port];
+
+    // Sensitivity is the percentage of full deflection at 100 degrees per second, and acceleration is how much
+    // more gain (as a percentage) there is at 360 degrees per second, growing linearly with speed
+    t.enabled = s.enabled;
+    t.sign[0] = s.invert[0] ? -1 : 1;
+    t.sign[1] = s.invert[1] ? -1 : 1;
+    t.deadband = s.deadband * DEGREE_RATE;
+    t.gain = ((int64_t)s.sensitivity * AXIS_FULL << IMU_SHIFT) / (100 * SENSITIVITY_RATE);
+    t.acceleration = ((int64_t)s.acceleration << (IMU_SHIFT * 2)) / (100 * ACCELERATION_RATE);
+    t.ratchet = s.ratchet;
+}
+
+void GyroAim::update(const AimTables &t, const ImuDescriptor &desc, const int32_t *rate, uint32_t buttons, int32_t *deflection)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        deflection[i] = 0;
+        if (!t.enabled || (buttons & t.ratchet))
+            continue;
+
+        // Pick the rotation that moves this stick axis, pointed the right way for the controller's sensor
+        int axis = desc.aimAxes[i];
+        int32_t value = (axis < 0) ? -rate[-axis - 1] : rate[axis - 1];
+        int32_t magnitude = ((value < 0) ? -value : value) - t.deadband;
+        if (magnitude <= 0)
+            continue;
+
+        // Scale the rate past the deadband by the sensitivity, and by more the faster it is
+        int64_t factor = (1 << IMU_SHIFT) + ((magnitude * t.acceleration) >> IMU_SHIFT);
+        int64_t result = ((magnitude * t.gain) >> IMU_SHIFT) * factor >> IMU_SHIFT;
+        if (result > AXIS_FULL)
+            result = AXIS_FULL;
+        deflection[i] = (value < 0) ? -result * t.sign[i] : result * t.sign[i];
+    }
+}
+
+static inline uint16_t addAxis(uint16_t axis, int32_t deflection)
+{
+    int value = axis + deflection;
+    return (value < 0) ? 0 : (value > 0xFFFF) ? 0xFFFF : value;
+}
+
+void GyroAim::apply(const AimTables &t, const int32_t *deflection, ControlData *out)
+{
+    if (!t.enabled)
+        return;
+
+    // Add the rotation on top of the shaped right stick, so both can be used at once
+    out->rightX = addAxis(out->rightX, deflection[0]);
+    out->rightY = addAxis(out->rightY, deflection[1]);
+}
@@ -0,0 +1,32 @@
+#ifndef GYRO_AIM_H
+#define GYRO_AIM_H
+
+#include <stdint.h>
+
+#include "controller.h"
+
+// Gyro aiming, which turns a controller's rotation into right stick deflection for games without motion controls.
+// It's off unless enabled under [gyro] (every controller) or [gyro N] (controller N) sections in the config file, and
+// is worked out in fixed point for each motion sample, so it only adds two additions to each report's stick output.
+struct AimTables
+{
+    bool enabled;
+    int sign[2];
+    int32_t deadband;
+    int64_t gain;
+    int64_t acceleration;
+    uint32_t ratchet;
+};
+
+namespace GyroAim
+{
+
+void reset();
+bool setOption(const char *port, const char *key, const char *value);
+void compile(int port, AimTables &t);
+void update(const AimTables &t, const ImuDescriptor &desc, const int32_t *rate, uint32_t buttons, int32_t *deflection);
+void apply(const AimTables &t, const int32_t *deflection, ControlData *out);
+
+};
+
+#endif // GYRO_AIM_H
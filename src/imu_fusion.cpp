@@ -0,0 +1,205 @@
+#include "imu_fusion.h"
+
+// Filter gains, with IMU_SHIFT fractional bits: proportional and integral corrections from gravity, and a stronger
+// proportional gain while the filter settles after the first sample
+#define GAIN_KP       (2 << IMU_SHIFT)
+#define GAIN_KI       (1 << (IMU_SHIFT - 7))
+#define GAIN_KP_START (20 << IMU_SHIFT)
+
+// Time spent settling, and the longest step integrated at once, in microseconds
+#define START_TIME 500000
+#define MAX_STEP   50000
+
+// Accelerometer readings further than this from 1 g are movement rather than gravity, and aren't used for correction
+// (squared magnitudes with 30 fractional bits, so 0.8 to 1.2 g)
+#define GRAVITY_MIN (((int64_t)1 << UNIT_SHIFT) * 64 / 100)
+#define GRAVITY_MAX (((int64_t)1 << UNIT_SHIFT) * 144 / 100)
+
+// Fractional bits of step lengths in seconds, and microseconds in that format with 10 more bits (avoids a division)
+#define STEP_SHIFT  24
+#define STEP_PER_US 17180
+
+static inline int32_t mulUnit(int64_t a, int64_t b)
+{
+    return (a * b) >> UNIT_SHIFT;
+}
+
+static inline int32_t invSqrt(int32_t value)
+{
+    // Newton's method for 1 / sqrt(value) starting from 1, which converges quickly for the near-unit values used here
+    int32_t result = 1 << UNIT_SHIFT;
+    for (int i = 0; i < 3; i++)
+    {
+        int64_t factor = ((int64_t)3 << UNIT_SHIFT) - mulUnit(value, mulUnit(result, result));
+        result = (result * factor) >> (UNIT_SHIFT + 1);
+    }
+    return result;
+}
+
+void ImuFusion::update(const ImuDescriptor &desc, const int16_t accel[3], const int16_t gyro[3], uint64_t time)
+{
+    // Convert the raw readings to g and rad/s
+    int32_t a[3], g[3];
+    for (int i = 0; i < 3; i++)
+    {
+        a[i] = (accel[i] * desc.accelScale) >> (IMU_SCALE_SHIFT - IMU_SHIFT);
+        g[i] = rate[i] = (gyro[i] * desc.gyroScale) >> (IMU_SCALE_SHIFT - IMU_SHIFT);
+    }
+
+    // Get the step length since the last sample, limited so a gap in reports can't throw the orientation off
+    if (!startTime)
+        startTime = lastTime = time;
+    uint64_t delta = (time > lastTime) ? (time - lastTime) : 0;
+    uint32_t elapsed = (delta < MAX_STEP) ? delta : MAX_STEP;
+    int32_t step = (elapsed * STEP_PER_US) >> 10;
+    lastTime = time;
+
+    int32_t w = quat[0], x = quat[1], y = quat[2], z = quat[3];
+
+    // Estimate which way is up in controller space from the current orientation
+    int32_t up[3] =
+    {
+        2 * (mulUnit(x, z) - mulUnit(w, y)),
+        2 * (mulUnit(w, x) + mulUnit(y, z)),
+        mulUnit(w, w) - mulUnit(x, x) - mulUnit(y, y) + mulUnit(z, z)
+    };
+
+    // Steer the estimate towards the measured gravity, if the controller isn't being shaken around
+    int64_t length = (int64_t)a[0] * a[0] + (int64_t)a[1] * a[1] + (int64_t)a[2] * a[2];
+    length >>= IMU_SHIFT * 2 - UNIT_SHIFT;
+    if (length > GRAVITY_MIN && length < GRAVITY_MAX)
+    {
+        int32_t scale = invSqrt(length);
+        int32_t n[3];
+        for (int i = 0; i < 3; i++)
+            n[i] = ((int64_t)a[i] * scale) >> IMU_SHIFT;
+
+        // The cross product of measured and estimated up is the rotation error
+        int32_t error[3] =
+        {
+            mulUnit(n[1], up[2]) - mulUnit(n[2], up[1]),
+            mulUnit(n[2], up[0]) - mulUnit(n[0], up[2]),
+            mulUnit(n[0], up[1]) - mulUnit(n[1], up[0])
+        };
+
+        int32_t kp = (time - startTime < START_TIME) ? GAIN_KP_START : GAIN_KP;
+        for (int i = 0; i < 3; i++)
+        {
+            integral[i] += ((int64_t)mulUnit(error[i], GAIN_KI) * step) >> STEP_SHIFT;
+            g[i] += mulUnit(error[i], kp) + integral[i];
+        }
+    }
+
+    // Integrate the rotation rate: q += q * (0, g) * step / 2
+    int64_t dw = -(int64_t)x * g[0] - (int64_t)y * g[1] - (int64_t)z * g[2];
+    int64_t dx =  (int64_t)w * g[0] + (int64_t)y * g[2] - (int64_t)z * g[1];
+    int64_t dy =  (int64_t)w * g[1] - (int64_t)x * g[2] + (int64_t)z * g[0];
+    int64_t dz =  (int64_t)w * g[2] + (int64_t)x * g[1] - (int64_t)y * g[0];
+    w += ((dw >> IMU_SHIFT) * step) >> (STEP_SHIFT + 1);
+    x += ((dx >> IMU_SHIFT) * step) >> (STEP_SHIFT + 1);
+    y += ((dy >> IMU_SHIFT) * step) >> (STEP_SHIFT + 1);
+    z += ((dz >> IMU_SHIFT) * step) >> (STEP_SHIFT + 1);
+
+    // Bring the quaternion back to unit length
+    int32_t scale = invSqrt(mulUnit(w, w) + mulUnit(x, x) + mulUnit(y, y) + mulUnit(z, z));
+    quat[0] = mulUnit(w, scale);
+    quat[1] = mulUnit(x, scale);
+    quat[2] = mulUnit(y, scale);
+    quat[3] = mulUnit(z, scale);
+
+    pushSample(a, rate, time);
+    publish(a, rate, up, time);
+}
+
+void ImuFusion::pushSample(const int32_t accel[3], const int32_t gyro[3], uint64_t time)
+{
+    // Overwrite the oldest entry, invalidating it first in case it's being read
+    uint32_t counter = sampleCount + 1;
+    ImuSample *sample = &samples[counter % IMU_SAMPLES];
+    sample->counter = 0;
+    __sync_synchronize();
+
+    sample->time = time;
+    for (int i = 0; i < 3; i++)
+    {
+        sample->accel[i] = accel[i];
+        sample->gyro[i]  = gyro[i];
+    }
+
+    __sync_synchronize();
+    sample->counter = counter;
+    sampleCount = counter;
+}
+
+void ImuFusion::publish(const int32_t accel[3], const int32_t gyro[3], const int32_t up[3], uint64_t time)
+{
+    int32_t w = quat[0], x = quat[1], y = quat[2], z = quat[3];
+
+    sequence++;
+    __sync_synchronize();
+
+    state.time = time;
+    for (int i = 0; i < 3; i++)
+    {
+        state.accel[i] = accel[i];
+        state.gyro[i]  = gyro[i];
+    }
+
+    state.quat[0] = x;
+    state.quat[1] = y;
+    state.quat[2] = z;
+    state.quat[3] = w;
+
+    // Rotation matrix of the quaternion, from controller space to world space
+    state.matrix[0][0] = (1 << UNIT_SHIFT) - 2 * (mulUnit(y, y) + mulUnit(z, z));
+    state.matrix[0][1] = 2 * (mulUnit(x, y) - mulUnit(w, z));
+    state.matrix[0][2] = 2 * (mulUnit(x, z) + mulUnit(w, y));
+    state.matrix[1][0] = 2 * (mulUnit(x, y) + mulUnit(w, z));
+    state.matrix[1][1] = (1 << UNIT_SHIFT) - 2 * (mulUnit(x, x) + mulUnit(z, z));
+    state.matrix[1][2] = 2 * (mulUnit(y, z) - mulUnit(w, x));
+    state.matrix[2][0] = 2 * (mulUnit(x, z) - mulUnit(w, y));
+    state.matrix[2][1] = 2 * (mulUnit(y, z) + mulUnit(w, x));
+    state.matrix[2][2] = (1 << UNIT_SHIFT) - 2 * (mulUnit(x, x) + mulUnit(y, y));
+
+    // The basic orientation is the controller axis that points closest to up
+    int best = 0;
+    for (int i = 1; i < 3; i++)
+    {
+        if ((up[i] < 0 ? -up[i] : up[i]) > (up[best] < 0 ? -up[best] : up[best]))
+            best = i;
+    }
+    for (int i = 0; i < 3; i++)
+        state.basic[i] = (i != best) ? 0 : (up[i] < 0) ? -1 : 1;
+
+    __sync_synchronize();
+    sequence++;
+}
+
+bool ImuFusion::read(ImuState *out) const
+{
+    // Retry if a sample was published while copying; give up after a few tries rather than stall the caller
+    for (int i = 0; i < 4; i++)
+    {
+        uint32_t start = sequence;
+        if (!start || (start & 1))
+            continue;
+        __sync_synchronize();
+        *out = state;
+        __sync_synchronize();
+        if (sequence == start)
+            return true;
+    }
+    return false;
+}
+
+bool ImuFusion::readSample(uint32_t counter, ImuSample *out) const
+{
+    // Copy the sample, and make sure it wasn't replaced by a newer one before or during the copy
+    const volatile ImuSample *sample = &samples[counter % IMU_SAMPLES];
+    if (!counter || sample->counter != counter)
+        return false;
+    __sync_synchronize();
+    *out = *(const ImuSample*)sample;
+    __sync_synchronize();
+    return sample->counter == counter;
+}
@@ -0,0 +1,82 @@
+#ifndef IMU_FUSION_H
+#define IMU_FUSION_H
+
+#include <stdint.h>
+
+// Fractional bits of fused values: accelerations (in g) and rates (in rad/s) have 16, unit vectors and matrices have 30
+#define IMU_SHIFT  16
+#define UNIT_SHIFT 30
+
+// Fractional bits of the multipliers that convert raw sensor values
+#define IMU_SCALE_SHIFT 24
+
+// Recent samples kept for functions that return several at once
+#define IMU_SAMPLES 64
+
+// Resolutions of a controller's accelerometer and gyroscope, as multipliers from raw values to g and rad/s, and the
+// gyroscope axes (numbered from 1, negative to reverse them) that turn the held controller right and up, for aiming
+struct ImuDescriptor
+{
+    int32_t accelScale;
+    int32_t gyroScale;
+    int8_t aimAxes[2];
+};
+
+constexpr ImuDescriptor makeImuDescriptor(double accelPerG, double gyroPerDegree, int yawAxis, int pitchAxis)
+{
+    return { (int32_t)((1 << IMU_SCALE_SHIFT) / accelPerG + 0.5),
+        (int32_t)((1 << IMU_SCALE_SHIFT) * 3.14159265358979 / 180 / gyroPerDegree + 0.5),
+        { (int8_t)yawAxis, (int8_t)pitchAxis } };
+}
+
+// A complete fused motion sample, ready to be converted for the system's motion functions
+struct ImuState
+{
+    uint64_t time;
+    int32_t accel[3];
+    int32_t gyro[3];
+    int32_t quat[4]; // x, y, z, w
+    int32_t matrix[3][3];
+    int8_t basic[3];
+};
+
+// A single converted sensor reading; counters start at 1 and increase with every sample
+struct ImuSample
+{
+    uint64_t time;
+    uint32_t counter;
+    int32_t accel[3];
+    int32_t gyro[3];
+};
+
+// Mahony orientation filter in fixed point, so it can run on the decode thread for every sample without touching
+// the FPU. Gravity from the accelerometer corrects pitch and roll drift; yaw is relative to the starting orientation.
+class ImuFusion
+{
+    public:
+        void update(const ImuDescriptor &desc, const int16_t accel[3], const int16_t gyro[3], uint64_t time);
+        bool read(ImuState *out) const;
+        bool readSample(uint32_t counter, ImuSample *out) const;
+        uint32_t getSampleCount() const { return sampleCount; }
+        const int32_t *getRate() const { return rate; }
+
+    private:
+        int32_t quat[4] = { 1 << UNIT_SHIFT, 0, 0, 0 }; // w, x, y, z
+        int32_t integral[3] = {};
+        int32_t rate[3] = {};
+        uint64_t startTime = 0;
+        uint64_t lastTime = 0;
+
+        // Published state, guarded by a sequence count that's odd while it's being written
+        ImuState state = {};
+        volatile uint32_t sequence = 0;
+
+        // Ring of recent samples; each entry's counter is cleared while it's being written
+        ImuSample samples[IMU_SAMPLES] = {};
+        volatile uint32_t sampleCount = 0;
+
+        void pushSample(const int32_t accel[3], const int32_t gyro[3], uint64_t time);
+        void publish(const int32_t accel[3], const int32_t gyro[3], const int32_t up[3], uint64_t time);
+};
+
+#endif // IMU_FUSION_H
@@ -0,0 +1,50 @@
+#include <psp2kern/kernel/threadmgr.h>
+
+#include "log.h"
+
+volatile uint8_t Log::levels[VITACONTROL_LOG_CATEGORY_COUNT] =
+{
+    LOG_LEVEL_INFO, // LOG_CORE
+    LOG_LEVEL_INFO, // LOG_BT
+    LOG_LEVEL_INFO, // LOG_DRIVER
+    LOG_LEVEL_WARN, // LOG_REPORT
+    LOG_LEVEL_INFO  // LOG_RAWLOG
+};
+
+bool Log::RateLimit::allow(uint32_t interval)
+{
+    // Hold the message back if the last one from this call site was too recent
+    uint64_t now = ksceKernelGetSystemTimeWide();
+    if (now < next)
+    {
+        suppressed++;
+        return false;
+    }
+
+    // Note how many messages were skipped since the last one that got through
+    if (suppressed)
+    {
+        ksceDebugPrintf("[VitaControl] (%u similar messages suppressed)\n", suppressed);
+        suppressed = 0;
+    }
+
+    next = now + interval;
+    return true;
+}
+
+void Log::setLevel(int category, int level)
+{
+    if (level < LOG_LEVEL_NONE || level > LOG_LEVEL_DEBUG)
+        return;
+
+    // Set the level for a single category, or for all of them
+    if (category >= 0 && category < VITACONTROL_LOG_CATEGORY_COUNT)
+    {
+        levels[category] = level;
+    }
+    else if (category == VITACONTROL_LOG_ALL)
+    {
+        for (int i = 0; i < VITACONTROL_LOG_CATEGORY_COUNT; i++)
+            levels[i] = level;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstdint>
+
+#include "../include/vitacontrol.h"
+
+// Logging function declaration
+extern "C" {
+    int ksceDebugPrintf(const char *fmt, ...);
+}
+
+// Levels, from most to least important
+#define LOG_LEVEL_NONE  VITACONTROL_LOG_NONE
+#define LOG_LEVEL_ERROR VITACONTROL_LOG_ERROR
+#define LOG_LEVEL_WARN  VITACONTROL_LOG_WARN
+#define LOG_LEVEL_INFO  VITACONTROL_LOG_INFO
+#define LOG_LEVEL_DEBUG VITACONTROL_LOG_DEBUG
+
+// Categories, used as indices into the runtime level table
+#define LOG_CORE   VITACONTROL_LOG_CORE   // Module start/stop and hooks
+#define LOG_BT     VITACONTROL_LOG_BT     // Bluetooth connections and request replies
+#define LOG_DRIVER VITACONTROL_LOG_DRIVER // Controller detection and drivers
+#define LOG_REPORT VITACONTROL_LOG_REPORT // Per-report messages on the input path
+#define LOG_RAWLOG VITACONTROL_LOG_RAWLOG // Raw report logging
+
+// Highest level compiled in; anything above it is removed entirely (override with -DLOG_MAX_LEVEL=...)
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Categories compiled in, as a bitmask of (1 << category)
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES 0xFFFFFFFF
+#endif
+
+#define LOG_COMPILED(cat, level) \
+    ((level) <= LOG_MAX_LEVEL && (LOG_CATEGORIES & (1 << (cat))))
+
+// Log a message if its level is compiled in and enabled at runtime for the category
+// The first check is constant, so disabled messages cost nothing; enabled ones cost a single compare
+#define LOG_AT(cat, level, ...) \
+    do { \
+        if (LOG_COMPILED(cat, level) && Log::levels[cat] >= (level)) \
+            ksceDebugPrintf("[VitaControl] " __VA_ARGS__); \
+    } while (0)
+
+// Like LOG_AT, but let at most one message through per interval (in microseconds) from each call site
+// Messages that were held back are counted and reported with the next one that gets through
+#define LOG_RATE(cat, level, interval, ...) \
+    do { \
+        if (LOG_COMPILED(cat, level) && Log::levels[cat] >= (level)) \
+        { \
+            static Log::RateLimit limit = {}; \
+            if (limit.allow(interval)) \
+                ksceDebugPrintf("[VitaControl] " __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_ERROR(cat, ...) LOG_AT(cat, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(cat, ...)  LOG_AT(cat, LOG_LEVEL_WARN,  __VA_ARGS__)
+#define LOG_INFO(cat, ...)  LOG_AT(cat, LOG_LEVEL_INFO,  __VA_ARGS__)
+#define LOG_DEBUG(cat, ...) LOG_AT(cat, LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+namespace Log
+{
+
+// Runtime level for each category; messages above it are skipped
+extern volatile uint8_t levels[VITACONTROL_LOG_CATEGORY_COUNT];
+
+struct RateLimit
+{
+    uint64_t next;
+    uint32_t suppressed;
+
+    bool allow(uint32_t interval);
+};
+
+void setLevel(int category, int level);
+
+};
+
+#endif // LOG_H
@@ -5,6 +5,7 @@
 #include <psp2/touch.h>
 #include <psp2kern/bt.h>
 #include <psp2kern/ctrl.h>
+#include <psp2kern/kernel/cpu.h>
 #include <psp2kern/kernel/modulemgr.h>
 #include <psp2kern/kernel/suspend.h>
 #include <psp2kern/kernel/threadmgr.h>
@@ -12,27 +13,38 @@
 #include <psp2kern/io/fcntl.h>
 #include <psp2kern/io/stat.h>
 
+#include "capture.h"
+#include "config.h"
 #include "controller.h"
+#include "device_cache.h"
+#include "log.h"
 #include "mempool.h"
-#include "vitacontrol_filelog.h"
+#include "polling.h"
+#include "profiles.h"
+#include "raw_log.h"
+#include "stats.h"
+#include "../include/vitacontrol.h"
 
-// Logging function declaration
-extern "C" {
-    int ksceDebugPrintf(const char *fmt, ...);
-}
+#define MAX_CONTROLLERS 4
 
-// Logging macro
-#define LOG(...) ksceDebugPrintf("[VitaControl] " __VA_ARGS__)
+// Event flags for the callback thread: stop, or wake up for deferred reads and saving the device cache
+#define FLAG_EXIT (1 << 0)
+#define FLAG_POLL (1 << 1)
 
-#define MAX_CONTROLLERS 4
+// Stack size of the callback thread, which also installs and removes hooks
+#define CALLBACK_STACK_SIZE 0x4000
 
-#define TOUCHSCREEN_WIDTH  1920
-#define TOUCHSCREEN_HEIGHT 1080
+// Groups of hooks, which are only installed while a connected controller uses them
+#define HOOKS_CTRL   (1 << 0)
+#define HOOKS_TOUCH  (1 << 1)
+#define HOOKS_MOTION (1 << 2)
 
-#define FLAG_EXIT (1 << 0)
+// How long hook groups stay installed after they're last used, so a controller that reconnects doesn't patch the
+// system functions again, in microseconds
+#define HOOK_RELEASE_DELAY 3000000
 
 #define AXIS_MOVED(axis) \
-    (abs((int8_t)(axis - 128)) > 20)
+    (abs((int)((axis) >> 8) - 128) > 20)
 
 // Redefinition for C++; requires type to specify parameters
 #undef TAI_CONTINUE
@@ -60,6 +72,7 @@ extern "C" {
 ({                                                             \
     if (name##HookUid > 0)                                     \
         taiHookReleaseForKernel(name##HookUid, name##HookRef); \
+    name##HookUid = -1;                                        \
 })
 
 SceUID Mempool::uid = -1;
@@ -68,97 +81,6 @@ static SceUID threadUid = -1;
 
 static Controller *controllers[MAX_CONTROLLERS] = {};
 
-static int g_logFd = -1;
-
-struct RawLogState
-{
-    bool hasLast = false;
-    uint8_t last[64] = {};
-};
-
-static RawLogState g_rawLogStates[MAX_CONTROLLERS] = {};
-static uint8_t g_lastReportId[MAX_CONTROLLERS] = {};
-
-extern "C" void vitacontrolFileLogWrite(const char *buf, size_t len)
-{
-    if (g_logFd < 0 || !buf || len == 0)
-        return;
-    ksceIoWrite(g_logFd, buf, len);
-}
-
-static inline void appendHex2(char *&p, unsigned v)
-{
-    static const char *hex = "0123456789ABCDEF";
-    *p++ = hex[(v >> 4) & 0xF];
-    *p++ = hex[(v >> 0) & 0xF];
-}
-
-static inline void appendStr(char *&p, const char *s)
-{
-    while (*s) *p++ = *s++;
-}
-
-static void rawLogDeltaForSlot(int slot, const uint8_t *buf, size_t len)
-{
-    if (g_logFd < 0 || slot < 0 || slot >= MAX_CONTROLLERS || !buf || len < 1)
-        return;
-
-    size_t maxBytes = (len > 64) ? 64 : len;
-    RawLogState &st = g_rawLogStates[slot];
-
-    if (!st.hasLast)
-    {
-        for (size_t i = 0; i < maxBytes; i++)
-            st.last[i] = buf[i];
-        st.hasLast = true;
-        return; // don't write a line until we have a delta (keeps file clean for mapper)
-    }
-
-    bool any = false;
-    for (size_t i = 0; i < maxBytes; i++)
-    {
-        if (st.last[i] != buf[i]) { any = true; break; }
-    }
-    if (!any) return;
-
-    // Format (parseable by mapper): id=.. b1=.. b2=.. b3=.. b4=.. b5=.. b6=.. b7=.. ch=[idx:old>new,...]\n
-    char line[256];
-    char *p = line;
-    appendStr(p, "id=");
-    appendHex2(p, buf[0]);
-    if (maxBytes >= 8)
-    {
-        appendStr(p, " b1="); appendHex2(p, buf[1]);
-        appendStr(p, " b2="); appendHex2(p, buf[2]);
-        appendStr(p, " b3="); appendHex2(p, buf[3]);
-        appendStr(p, " b4="); appendHex2(p, buf[4]);
-        appendStr(p, " b5="); appendHex2(p, buf[5]);
-        appendStr(p, " b6="); appendHex2(p, buf[6]);
-        appendStr(p, " b7="); appendHex2(p, buf[7]);
-    }
-    appendStr(p, " ch=[");
-    bool first = true;
-    for (size_t i = 0; i < maxBytes; i++)
-    {
-        if (st.last[i] == buf[i]) continue;
-        if (!first) *p++ = ',';
-        if (i >= 10) *p++ = (char)('0' + (i / 10));
-        *p++ = (char)('0' + (i % 10));
-        *p++ = ':';
-        appendHex2(p, st.last[i]);
-        *p++ = '>';
-        appendHex2(p, buf[i]);
-        first = false;
-    }
-    *p++ = ']';
-    *p++ = '\n';
-    vitacontrolFileLogWrite(line, (size_t)(p - line));
-
-    // update baseline
-    for (size_t i = 0; i < maxBytes; i++)
-        st.last[i] = buf[i];
-}
-
 static inline int clamp(int value, int min, int max)
 {
     if (value <= min) return min;
@@ -166,11 +88,6 @@ static inline int clamp(int value, int min, int max)
     return value;
 }
 
-static inline int scaleTouchCoord(int coord, int size, int dead, int vitaSize)
-{
-    return clamp(((coord - dead) * vitaSize) / (size - dead * 2), 0, vitaSize - 1);
-}
-
 DECL_FUNC_HOOK(sceBt0x22999C8, void *ptr0, void *ptr1)
 {
     uint32_t flags = *(uint32_t*)((uint32_t)ptr1 + 4);
@@ -204,7 +121,7 @@ DECL_FUNC_HOOK(ksceCtrlGetControllerPortInfo, SceCtrlPortInfo *info)
 
 DECL_FUNC_HOOK(sceCtrlGetBatteryInfo, int port, uint8_t *batt)
 {
-    if (port > 0 && controllers[port - 1])
+    if (port > 0 && port <= MAX_CONTROLLERS && controllers[port - 1])
     {
         // Override the battery level for connected controllers
         uint8_t data;
@@ -217,17 +134,51 @@ DECL_FUNC_HOOK(sceCtrlGetBatteryInfo, int port, uint8_t *batt)
     return TAI_CONTINUE(int(*)(int, uint8_t*), sceCtrlGetBatteryInfoHookRef, port, batt);
 }
 
-static void patchControlData(int port, SceCtrlData *data, int count, bool negative)
+DECL_FUNC_HOOK(sceCtrlSetActuator, int port, const SceCtrlActuator *state)
+{
+    if (port > 0 && port <= MAX_CONTROLLERS && controllers[port - 1])
+    {
+        // Pass the motor values to connected controllers; they're sent along with the next input report
+        SceCtrlActuator data;
+        int ret = ksceKernelMemcpyUserToKernel(&data, (void*)state, sizeof(SceCtrlActuator));
+        if (ret < 0)
+            return ret;
+        controllers[port - 1]->setRumble(data.small, data.large);
+        return 0;
+    }
+
+    return TAI_CONTINUE(int(*)(int, const SceCtrlActuator*), sceCtrlSetActuatorHookRef, port, state);
+}
+
+static inline uint8_t triggerValue(uint16_t analog, bool pressed)
+{
+    // Controllers with digital triggers only report the button, so treat it as fully pressed
+    uint8_t value = analog >> 8;
+    return (pressed && !value) ? 255 : value;
+}
+
+static void patchControlData(int port, SceCtrlData *data, int count, bool negative, bool extended)
 {
     // Use controller 1 data for port 0, or controllers 1-4 for ports 1-4
     int cont = (port > 0) ? (port - 1) : 0;
     if (!controllers[cont]) return;
     const ControlData *controlData = controllers[cont]->getControlData();
 
+    Stats::hookCalled(VITACONTROL_HOOK_CTRL);
+    Stats::reportRead(cont);
+
     // Forward PS button presses to the kernel so the system menu receives them
     if (controlData->buttons & SCE_CTRL_PSBUTTON)
         ksceCtrlSetButtonEmulation(port, 0, 0, SCE_CTRL_PSBUTTON, 16);
 
+    // Analog values are reduced to the system's 8 bits only here
+    uint8_t leftX  = controlData->leftX  >> 8;
+    uint8_t leftY  = controlData->leftY  >> 8;
+    uint8_t rightX = controlData->rightX >> 8;
+    uint8_t rightY = controlData->rightY >> 8;
+    uint8_t leftTrigger  = triggerValue(controlData->leftTrigger,  controlData->buttons & SCE_CTRL_LTRIGGER);
+    uint8_t rightTrigger = triggerValue(controlData->rightTrigger, controlData->buttons & SCE_CTRL_RTRIGGER);
+
     for (int i = 0; i < count; i++)
     {
         // Reset initial values for controller ports (port 0 is additive)
@@ -238,67 +189,88 @@ static void patchControlData(int port, SceCtrlData *data, int count, bool negati
         }
 
         // Set the button data from the controller, with optional negative logic
-        // TODO: properly handle extended/analog triggers
         if (negative)
             data[i].buttons &= ~controlData->buttons;
         else
             data[i].buttons |= controlData->buttons;
 
         // Set the stick data from the controller
-        data[i].lx = clamp(data[i].lx + controlData->leftX  - 127, 0, 255);
-        data[i].ly = clamp(data[i].ly + controlData->leftY  - 127, 0, 255);
-        data[i].rx = clamp(data[i].rx + controlData->rightX - 127, 0, 255);
-        data[i].ry = clamp(data[i].ry + controlData->rightY - 127, 0, 255);
+        data[i].lx = clamp(data[i].lx + leftX  - 127, 0, 255);
+        data[i].ly = clamp(data[i].ly + leftY  - 127, 0, 255);
+        data[i].rx = clamp(data[i].rx + rightX - 127, 0, 255);
+        data[i].ry = clamp(data[i].ry + rightY - 127, 0, 255);
+
+        // The *2 functions also report the analog triggers of external controllers
+        if (extended)
+        {
+            if (port > 0)
+                data[i].lt = data[i].rt = 0;
+            if (leftTrigger  > data[i].lt) data[i].lt = leftTrigger;
+            if (rightTrigger > data[i].rt) data[i].rt = rightTrigger;
+        }
     }
 }
 
-#define DECL_FUNC_HOOK_CTRL(name, negative)                                                       \
+#define DECL_FUNC_HOOK_CTRL(name, negative, extended)                                             \
     DECL_FUNC_HOOK(name, int port, SceCtrlData *data, int count)                                  \
     {                                                                                             \
         int ret = TAI_CONTINUE(int(*)(int, SceCtrlData*, int), name##HookRef, port, data, count); \
         if (ret >= 0)                                                                             \
-            patchControlData(port, data, count, (negative));                                      \
+            patchControlData(port, data, count, (negative), (extended));                          \
         return ret;                                                                               \
     }
 
-DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositive,     false)
-DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositive,     false)
-DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferNegative,     true)
-DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferNegative,     true)
-DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositiveExt,  false)
-DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositiveExt,  false)
+DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositive,     false, false)
+DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositive,     false, false)
+DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferNegative,     true,  false)
+DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferNegative,     true,  false)
+DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositiveExt,  false, false)
+DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositiveExt,  false, false)
 
-DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositive2,    false)
-DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositive2,    false)
-DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferNegative2,    true)
-DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferNegative2,    true)
-DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositiveExt2, false)
-DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositiveExt2, false)
+DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositive2,    false, true)
+DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositive2,    false, true)
+DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferNegative2,    true,  true)
+DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferNegative2,    true,  true)
+DECL_FUNC_HOOK_CTRL(ksceCtrlPeekBufferPositiveExt2, false, true)
+DECL_FUNC_HOOK_CTRL(ksceCtrlReadBufferPositiveExt2, false, true)
 
 static void patchTouchData(int port, SceTouchData *data, int count)
 {
     // Use controller 1 data for the front touch port
     if (port != SCE_TOUCH_PORT_FRONT || !controllers[0]) return;
-    const TouchData *touchData = controllers[0]->getTouchData();
+
+    Stats::hookCalled(VITACONTROL_HOOK_TOUCH);
 
     for (int i = 0; i < count; i++)
     {
-        int reportNum = 0;
-
-        // Add touches from the controller if present
-        for (int j = 0; j < 2; j++)
+        // The newest buffer gets the latest touches, and older ones (when several are read) get the controller frame
+        // that was current at their timestamp, so fast swipes aren't flattened into one repeated position
+        TouchData frame;
+        const TouchData *touchData = controllers[0]->getTouchData();
+        if (i < count - 1 && controllers[0]->getTouchFrame(data[i].timeStamp, &frame))
+            touchData = &frame;
+
+        // Nothing to merge if the controller wasn't touching its touchpad
+        if (!touchData->touchActive[0] && !touchData->touchActive[1]) continue;
+
+        // Add the controller's touches, already scaled, after the system's own for as long as there's room
+        uint32_t reportNum = data[i].reportNum;
+        if (reportNum > SCE_TOUCH_MAX_REPORT)
+            reportNum = SCE_TOUCH_MAX_REPORT;
+
+        for (int j = 0; j < 2 && reportNum < SCE_TOUCH_MAX_REPORT; j++)
         {
             if (!touchData->touchActive[j]) continue;
-            data[i].report[reportNum].id = touchData->touchId[j];
-            data[i].report[reportNum].x = scaleTouchCoord(touchData->touchX[j], touchData->touchWidth,  touchData->touchDeadX, TOUCHSCREEN_WIDTH);
-            data[i].report[reportNum].y = scaleTouchCoord(touchData->touchY[j], touchData->touchHeight, touchData->touchDeadY, TOUCHSCREEN_HEIGHT);
-            reportNum++;
+            SceTouchReport &report = data[i].report[reportNum++];
+            memset(&report, 0, sizeof(SceTouchReport));
+
+            // Controller touch ids are 7-bit counters; the top bit keeps them apart from the system's own ids
+            report.id = touchData->touchId[j] | 0x80;
+            report.x  = touchData->touchX[j];
+            report.y  = touchData->touchY[j];
         }
 
-        // If the controller provided touches, update the report number (system touches are overwritten and ignored)
-        // TODO: touches could be additive, if we make sure not to overflow... do we want that?
-        if (reportNum > 0)
-            data[i].reportNum = reportNum;
+        data[i].reportNum = reportNum;
     }
 }
 
@@ -316,30 +288,337 @@ DECL_FUNC_HOOK_TOUCH(ksceTouchPeekRegion)
 DECL_FUNC_HOOK_TOUCH(ksceTouchRead)
 DECL_FUNC_HOOK_TOUCH(ksceTouchReadRegion)
 
+// Fused values have fixed-point fractions; they're only converted to floats here, in the calling thread
+#define IMU_FLOAT(value)  ((float)(value) * (1.0f / (1 << IMU_SHIFT)))
+#define UNIT_FLOAT(value) ((float)(value) * (1.0f / (1 << UNIT_SHIFT)))
+
+static void setMatrixRow(SceFVector4 *row, const int32_t *values, int sign)
+{
+    row->x = UNIT_FLOAT(values[0] * sign);
+    row->y = UNIT_FLOAT(values[1] * sign);
+    row->z = UNIT_FLOAT(values[2] * sign);
+    row->w = 0.0f;
+}
+
+static void buildMotionState(const ImuState *imu, SceMotionState *data)
+{
+    memset(data, 0, sizeof(SceMotionState));
+    data->timestamp     = imu->time;
+    data->hostTimestamp = imu->time;
+
+    data->acceleration.x    = IMU_FLOAT(imu->accel[0]);
+    data->acceleration.y    = IMU_FLOAT(imu->accel[1]);
+    data->acceleration.z    = IMU_FLOAT(imu->accel[2]);
+    data->angularVelocity.x = IMU_FLOAT(imu->gyro[0]);
+    data->angularVelocity.y = IMU_FLOAT(imu->gyro[1]);
+    data->angularVelocity.z = IMU_FLOAT(imu->gyro[2]);
+
+    data->deviceQuat.x = UNIT_FLOAT(imu->quat[0]);
+    data->deviceQuat.y = UNIT_FLOAT(imu->quat[1]);
+    data->deviceQuat.z = UNIT_FLOAT(imu->quat[2]);
+    data->deviceQuat.w = UNIT_FLOAT(imu->quat[3]);
+
+    setMatrixRow(&data->rotationMatrix.x, imu->matrix[0], 1);
+    setMatrixRow(&data->rotationMatrix.y, imu->matrix[1], 1);
+    setMatrixRow(&data->rotationMatrix.z, imu->matrix[2], 1);
+    data->rotationMatrix.w.w = 1.0f;
+
+    // The same rotation in north, east and down axes; with no compass, north is where the controller first faced
+    setMatrixRow(&data->nedMatrix.x, imu->matrix[1], 1);
+    setMatrixRow(&data->nedMatrix.y, imu->matrix[0], 1);
+    setMatrixRow(&data->nedMatrix.z, imu->matrix[2], -1);
+    data->nedMatrix.w.w = 1.0f;
+
+    data->basicOrientation.x = imu->basic[0];
+    data->basicOrientation.y = imu->basic[1];
+    data->basicOrientation.z = imu->basic[2];
+}
+
 DECL_FUNC_HOOK(sceMotionGetState, SceMotionState *state)
 {
     int ret = TAI_CONTINUE(int(*)(SceMotionState*), sceMotionGetStateHookRef, state);
 
     if (ret >= 0 && controllers[0])
     {
-        // Use controller 1 data for the motion state
-        const MotionState *motionState = controllers[0]->getMotionState();
+        Stats::hookCalled(VITACONTROL_HOOK_MOTION);
 
-        // Set the acceleration and velocity from the controller
+        // Use controller 1 data for the motion state
         SceMotionState data;
-        ksceKernelMemcpyUserToKernel(&data, (void*)state, sizeof(SceMotionState));
-        data.acceleration.x    = motionState->accelerX;
-        data.acceleration.y    = motionState->accelerY;
-        data.acceleration.z    = motionState->accelerZ;
-        data.angularVelocity.x = motionState->velocityX;
-        data.angularVelocity.y = motionState->velocityY;
-        data.angularVelocity.z = motionState->velocityZ;
+        ImuState imu;
+        if (controllers[0]->getImuState(&imu))
+        {
+            // Replace the whole state with the fused one, so orientation matches the controller's movement
+            buildMotionState(&imu, &data);
+        }
+        else if (controllers[0]->hasFusedMotion())
+        {
+            // Raw values from a fused controller are sensor counts rather than g and rad/s, so leave the system's state
+            // alone if there's no fused one to return yet, or it was being updated on every try
+            return ret;
+        }
+        else
+        {
+            // Without fusion, only set the raw acceleration and velocity from the controller
+            const MotionState *motionState = controllers[0]->getMotionState();
+            ksceKernelMemcpyUserToKernel(&data, (void*)state, sizeof(SceMotionState));
+            data.acceleration.x    = motionState->accel[0];
+            data.acceleration.y    = motionState->accel[1];
+            data.acceleration.z    = motionState->accel[2];
+            data.angularVelocity.x = motionState->gyro[0];
+            data.angularVelocity.y = motionState->gyro[1];
+            data.angularVelocity.z = motionState->gyro[2];
+        }
         ksceKernelMemcpyKernelToUser((void*)state, &data, sizeof(SceMotionState));
     }
 
     return ret;
 }
 
+// Sensor states are built and copied to the caller in chunks, to keep them off the stack, and at most this many
+// different samples are returned, leaving room in the sample ring for new ones to arrive while copying
+#define SENSOR_CHUNK       8
+#define SENSOR_MAX_SAMPLES (IMU_SAMPLES - SENSOR_CHUNK)
+
+static void buildSensorState(const ImuSample *sample, SceMotionSensorState *data)
+{
+    memset(data, 0, sizeof(SceMotionSensorState));
+    data->accelerometer.x = IMU_FLOAT(sample->accel[0]);
+    data->accelerometer.y = IMU_FLOAT(sample->accel[1]);
+    data->accelerometer.z = IMU_FLOAT(sample->accel[2]);
+    data->gyro.x          = IMU_FLOAT(sample->gyro[0]);
+    data->gyro.y          = IMU_FLOAT(sample->gyro[1]);
+    data->gyro.z          = IMU_FLOAT(sample->gyro[2]);
+    data->timestamp       = sample->time;
+    data->counter         = sample->counter;
+    data->hostTimestamp   = sample->time;
+}
+
+DECL_FUNC_HOOK(sceMotionGetSensorState, SceMotionSensorState *sensorState, int numRecords)
+{
+    int ret = TAI_CONTINUE(int(*)(SceMotionSensorState*, int), sceMotionGetSensorStateHookRef,
+        sensorState, numRecords);
+
+    if (ret >= 0 && controllers[0] && numRecords > 0)
+    {
+        // Use controller 1 data, if it has buffered samples
+        uint32_t latest = controllers[0]->getImuSampleCount();
+        if (!latest) return ret;
+
+        Stats::hookCalled(VITACONTROL_HOOK_MOTION);
+
+        // Like the system's own function, this returns the latest samples from oldest to newest rather than keeping
+        // track of what each caller has read; games that call less often than the controller reports can use the
+        // counters to pick out every new sample. Every requested record is filled, repeating the oldest sample when
+        // fewer are buffered or more are asked for than can be returned.
+        int samples = (numRecords < SENSOR_MAX_SAMPLES) ? numRecords : SENSOR_MAX_SAMPLES;
+        int padding = numRecords - samples;
+
+        SceMotionSensorState data[SENSOR_CHUNK];
+        ImuSample sample;
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            int64_t first = (int64_t)latest - samples + 1;
+            bool valid = false;
+
+            for (int i = 0; i < numRecords; i += SENSOR_CHUNK)
+            {
+                int size = (numRecords - i < SENSOR_CHUNK) ? (numRecords - i) : SENSOR_CHUNK;
+                for (int j = 0; j < size; j++)
+                {
+                    int64_t counter = first + ((i + j > padding) ? (i + j - padding) : 0);
+
+                    // A sample replaced during the copy is covered by the one before it, so the buffer never mixes
+                    // in the system's data; if the first one was already replaced, start over from the newest
+                    if (controllers[0]->getImuSample((counter > 1) ? counter : 1, &sample))
+                        valid = true;
+                    else if (!valid)
+                        break;
+                    buildSensorState(&sample, &data[j]);
+                }
+                if (!valid)
+                    break;
+                ksceKernelMemcpyKernelToUser((void*)&sensorState[i], data, size * sizeof(SceMotionSensorState));
+            }
+
+            if (valid)
+                break;
+            latest = controllers[0]->getImuSampleCount();
+        }
+    }
+
+    return ret;
+}
+
+DECL_FUNC_HOOK(sceMotionGetBasicOrientation, SceFVector3 *basicOrientation)
+{
+    int ret = TAI_CONTINUE(int(*)(SceFVector3*), sceMotionGetBasicOrientationHookRef, basicOrientation);
+
+    if (ret >= 0 && controllers[0])
+    {
+        // Use controller 1 data for the basic orientation, if it has a fused one
+        ImuState imu;
+        if (!controllers[0]->getImuState(&imu)) return ret;
+
+        Stats::hookCalled(VITACONTROL_HOOK_MOTION);
+
+        SceFVector3 data;
+        data.x = imu.basic[0];
+        data.y = imu.basic[1];
+        data.z = imu.basic[2];
+        ksceKernelMemcpyKernelToUser((void*)basicOrientation, &data, sizeof(SceFVector3));
+    }
+
+    return ret;
+}
+
+// Hook groups that are installed, the SceCtrl module they're in, and when the ones no longer used will be removed
+static uint32_t hookGroups = 0;
+static SceUID ctrlModid = -1;
+static uint64_t hookReleaseTime = 0;
+
+static void bindHooks(uint32_t groups)
+{
+    if (groups & HOOKS_CTRL)
+    {
+        // Hook controller info functions
+        BIND_FUNC_EXPORT_HOOK(ksceCtrlGetControllerPortInfo, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0xF11D0D30);
+        BIND_FUNC_EXPORT_HOOK(sceCtrlGetBatteryInfo,         KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x8F9B1CE5);
+
+        // Hook controller vibration functions
+        BIND_FUNC_EXPORT_HOOK(sceCtrlSetActuator, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0xDBCAA0C9);
+
+        // Hook control data functions
+        BIND_FUNC_EXPORT_HOOK(ksceCtrlPeekBufferPositive, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0xEA1D3A34);
+        BIND_FUNC_EXPORT_HOOK(ksceCtrlReadBufferPositive, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x9B96A1AA);
+        BIND_FUNC_EXPORT_HOOK(ksceCtrlPeekBufferNegative, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x19895843);
+        BIND_FUNC_EXPORT_HOOK(ksceCtrlReadBufferNegative, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x8D4E0DD1);
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferPositiveExt,  KERNEL_PID, ctrlModid, 0, 0x3928 | 1, 1);
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferPositiveExt,  KERNEL_PID, ctrlModid, 0, 0x3BCC | 1, 1);
+
+        // Hook extended control data functions
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferPositive2,    KERNEL_PID, ctrlModid, 0, 0x3EF8 | 1, 1);
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferPositive2,    KERNEL_PID, ctrlModid, 0, 0x449C | 1, 1);
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferNegative2,    KERNEL_PID, ctrlModid, 0, 0x41C8 | 1, 1);
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferNegative2,    KERNEL_PID, ctrlModid, 0, 0x47F0 | 1, 1);
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferPositiveExt2, KERNEL_PID, ctrlModid, 0, 0x4B48 | 1, 1);
+        BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferPositiveExt2, KERNEL_PID, ctrlModid, 0, 0x4E14 | 1, 1);
+    }
+
+    if (groups & HOOKS_TOUCH)
+    {
+        // Hook touch data functions
+        BIND_FUNC_EXPORT_HOOK(ksceTouchPeek,       KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0xBAD1960B);
+        BIND_FUNC_EXPORT_HOOK(ksceTouchPeekRegion, KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0x9B3F7207);
+        BIND_FUNC_EXPORT_HOOK(ksceTouchRead,       KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0x70C8AACE);
+        BIND_FUNC_EXPORT_HOOK(ksceTouchReadRegion, KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0x9A91F624);
+    }
+
+    if (groups & HOOKS_MOTION)
+    {
+        // Hook motion state functions
+        BIND_FUNC_EXPORT_HOOK(sceMotionGetState,            KERNEL_PID, "SceMotion", TAI_ANY_LIBRARY, 0xBDB32767);
+        BIND_FUNC_EXPORT_HOOK(sceMotionGetSensorState,      KERNEL_PID, "SceMotion", TAI_ANY_LIBRARY, 0x47D679EA);
+        BIND_FUNC_EXPORT_HOOK(sceMotionGetBasicOrientation, KERNEL_PID, "SceMotion", TAI_ANY_LIBRARY, 0x4F28BFE0);
+    }
+
+    hookGroups |= groups;
+}
+
+static void unbindHooks(uint32_t groups)
+{
+    if (groups & HOOKS_CTRL)
+    {
+        // Unhook controller info functions
+        UNBIND_FUNC_HOOK(ksceCtrlGetControllerPortInfo);
+        UNBIND_FUNC_HOOK(sceCtrlGetBatteryInfo);
+
+        // Unhook controller vibration functions
+        UNBIND_FUNC_HOOK(sceCtrlSetActuator);
+
+        // Unhook control data functions
+        UNBIND_FUNC_HOOK(ksceCtrlReadBufferNegative);
+        UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositive);
+        UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositive);
+        UNBIND_FUNC_HOOK(ksceCtrlPeekBufferNegative);
+        UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositiveExt);
+        UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositiveExt);
+
+        // Unhook extended control data functions
+        UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositive2);
+        UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositive2);
+        UNBIND_FUNC_HOOK(ksceCtrlPeekBufferNegative2);
+        UNBIND_FUNC_HOOK(ksceCtrlReadBufferNegative2);
+        UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositiveExt2);
+        UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositiveExt2);
+    }
+
+    if (groups & HOOKS_TOUCH)
+    {
+        // Unhook touch data functions
+        UNBIND_FUNC_HOOK(ksceTouchPeek);
+        UNBIND_FUNC_HOOK(ksceTouchPeekRegion);
+        UNBIND_FUNC_HOOK(ksceTouchRead);
+        UNBIND_FUNC_HOOK(ksceTouchReadRegion);
+    }
+
+    if (groups & HOOKS_MOTION)
+    {
+        // Unhook motion state functions
+        UNBIND_FUNC_HOOK(sceMotionGetState);
+        UNBIND_FUNC_HOOK(sceMotionGetSensorState);
+        UNBIND_FUNC_HOOK(sceMotionGetBasicOrientation);
+    }
+
+    hookGroups &= ~groups;
+}
+
+static uint32_t getUsedHooks()
+{
+    // Control data is patched for any controller, but touch and motion only come from controller 1
+    uint32_t groups = 0;
+    for (int i = 0; i < MAX_CONTROLLERS; i++)
+    {
+        if (controllers[i])
+            groups |= HOOKS_CTRL;
+    }
+    if (controllers[0] && controllers[0]->hasTouch())
+        groups |= HOOKS_TOUCH;
+    if (controllers[0] && controllers[0]->hasMotion())
+        groups |= HOOKS_MOTION;
+    return groups;
+}
+
+static uint64_t updateHooks(uint64_t time)
+{
+    // Install groups as soon as a controller uses them
+    uint32_t used = getUsedHooks();
+    if (used & ~hookGroups)
+    {
+        LOG_INFO(LOG_CORE, "Installing hooks (groups 0x%X)\n", used & ~hookGroups);
+        bindHooks(used & ~hookGroups);
+    }
+
+    // Remove groups that are no longer used once they've stayed that way for a while, and return when that will be
+    uint32_t unused = hookGroups & ~used;
+    if (!unused)
+    {
+        hookReleaseTime = 0;
+        return 0;
+    }
+    if (!hookReleaseTime)
+        hookReleaseTime = time + HOOK_RELEASE_DELAY;
+    if (time < hookReleaseTime)
+        return hookReleaseTime;
+
+    LOG_INFO(LOG_CORE, "Removing hooks (groups 0x%X)\n", unused);
+    unbindHooks(unused);
+    hookReleaseTime = 0;
+    return 0;
+}
+
+// Time of the last power tick, which are limited since inputs can be held for a long time
+static uint64_t powerTickTime = 0;
+
 static int bluetoothCallback(int notifyId, int notifyCount, int notifyArg, void *common)
 {
     static uint8_t buffer[0x100];
@@ -377,7 +656,7 @@ static int bluetoothCallback(int notifyId, int notifyCount, int notifyArg, void
 
         if (cont == -1)
         {
-            LOG("  No free controller slots!\n");
+            LOG_WARN(LOG_BT, "  No free controller slots!\n");
             return 0;
         }
     }
@@ -386,72 +665,123 @@ static int bluetoothCallback(int notifyId, int notifyCount, int notifyArg, void
     switch (event.id)
     {
         case 0x05: // Connection accepted
-            LOG("  Connection accepted (slot %d)\n", cont);
-            // Try to create a controller instance for the device
-            if (!controllers[cont])
+            LOG_INFO(LOG_BT, "  Connection accepted (slot %d)\n", cont);
             {
-                controllers[cont] = Controller::makeController(event.mac0, event.mac1, cont);
-                if (controllers[cont])
-                    LOG("  Controller created successfully\n");
-                else
-                    LOG("  Failed to create controller (unknown VID/PID?)\n");
-            }
-            // Kick off input polling immediately. Some controllers never send any init write/feature
-            // replies, so without an initial read request we will never receive 0x0A events.
-            if (controllers[cont])
-            {
-                LOG("  Starting initial HID read...\n");
-                controllers[cont]->requestReport(HID_REQUEST_READ, buffer, sizeof(buffer));
+                // Get the device's VID and PID, from the cache if it's connected before
+                uint64_t time = ksceKernelGetSystemTimeWide();
+                uint16_t id[2];
+                bool cached = DeviceCache::getVidPid(event.mac0, event.mac1, id);
+                LOG_INFO(LOG_DRIVER, "  Device VID:PID = 0x%04X:0x%04X%s\n", id[0], id[1], cached ? " (cached)" : "");
+
+                // Tag logged reports with the device, even if it has no driver yet
+                RawLog::setDevice(cont, id[0], id[1]);
+
+                // Try to create a controller instance for the device
+                if (!controllers[cont])
+                {
+                    controllers[cont] = Controller::makeController(event.mac0, event.mac1, cont, id);
+                    if (controllers[cont])
+                    {
+                        LOG_INFO(LOG_DRIVER, "  Controller created successfully\n");
+                        Stats::connect(cont, time, cached);
+
+                        // Start the driver's setup, which starts reading input once the controller is ready for it;
+                        // a repeated event for a controller that already exists leaves its setup where it is
+                        controllers[cont]->start(buffer, sizeof(buffer));
+                    }
+                    else
+                        LOG_WARN(LOG_DRIVER, "  Failed to create controller (unknown VID/PID?)\n");
+                }
             }
             break;
 
         case 0x06: // Connection terminated
-            LOG("  Connection terminated (slot %d)\n", cont);
+            LOG_INFO(LOG_BT, "  Connection terminated (slot %d)\n", cont);
             // Remove the controller instance for the device
             if (controllers[cont])
             {
+                // Forget what was cached about a device that never got as far as sending input, so it starts over
+                if (!controllers[cont]->hasDecodedInput())
+                    DeviceCache::remove(controllers[cont]->getMac0(), controllers[cont]->getMac1());
                 Mempool::free(controllers[cont]);
                 controllers[cont] = nullptr;
+                Stats::disconnect(cont);
             }
             break;
 
         case 0x0A: // Reply to read request
+            // Queue the raw report for the log; formatting and file writes happen on the log thread
+            if (RawLog::isEnabled())
+                RawLog::push(cont, buffer, sizeof(buffer));
+            if (Capture::isEnabled())
+                Capture::push(cont, buffer, sizeof(buffer));
+
             if (controllers[cont])
             {
-                // Process the received input report and request another
-                controllers[cont]->processReport(buffer, sizeof(buffer));
-                controllers[cont]->requestReport(HID_REQUEST_READ, buffer, sizeof(buffer));
-
-                // Keep the screen awake when inputs are pressed
-                const ControlData *c = controllers[cont]->getControlData();
-                const TouchData *t = controllers[cont]->getTouchData();
-                if (c->buttons || t->touchActive[0] || t->touchActive[1] || AXIS_MOVED(c->leftX) ||
-                    AXIS_MOVED(c->leftY) || AXIS_MOVED(c->rightX) || AXIS_MOVED(c->rightY))
-                    ksceKernelPowerTick(SCE_KERNEL_POWER_TICK_DEFAULT);
+                // Process the received input report and request another, timing the decode
+                uint64_t time = ksceKernelGetSystemTimeWide();
+                Stats::reportReceived(cont, time);
+                controllers[cont]->completeRequest(HID_REQUEST_READ);
+                controllers[cont]->handleReport(buffer, sizeof(buffer), time);
+                Stats::reportDecoded(cont, ksceKernelGetSystemTimeWide() - time);
+                if (controllers[cont]->hasDecodedInput())
+                    Stats::firstInput(cont, time);
+
+                // Controllers that haven't been touched in a while are read at a lower rate, by the callback thread
+                if (controllers[cont]->wantsInput())
+                {
+                    uint32_t delay = Polling::getReadDelay(time - controllers[cont]->getActiveTime());
+                    if (delay)
+                        controllers[cont]->deferRead(time + delay);
+                    else
+                        controllers[cont]->requestRead();
+                }
+
+                // Send rumble changes right after an input report, so they can't delay the next one
+                controllers[cont]->updateRumble();
+
+                // Keep the screen awake when inputs are pressed, which only needs a tick every so often
+                if (time - powerTickTime >= Polling::getTickInterval())
+                {
+                    const ControlData *c = controllers[cont]->getControlData();
+                    const TouchData *t = controllers[cont]->getTouchData();
+                    if (c->buttons || t->touchActive[0] || t->touchActive[1] || AXIS_MOVED(c->leftX) ||
+                        AXIS_MOVED(c->leftY) || AXIS_MOVED(c->rightX) || AXIS_MOVED(c->rightY))
+                    {
+                        ksceKernelPowerTick(SCE_KERNEL_POWER_TICK_DEFAULT);
+                        powerTickTime = time;
+                    }
+                }
             }
             else
             {
-                // Log raw data even when no controller object exists
-                LOG("  Read report [slot %d, NO CONTROLLER]: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X\n",
+                // Log raw data even when no controller object exists, at most a few times per second
+                LOG_RATE(LOG_REPORT, LOG_LEVEL_DEBUG, 250000, "  Read report [slot %d, NO CONTROLLER]: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X\n",
                     cont, buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7],
                     buffer[8], buffer[9], buffer[10], buffer[11], buffer[12], buffer[13], buffer[14], buffer[15]);
             }
             break;
 
         case 0x0B: // Reply to write request
-            LOG("  Write request reply (slot %d)\n", cont);
-            // Request an initial input report (write/feature requests are typically part of controller init)
+            LOG_DEBUG(LOG_BT, "  Write request reply (slot %d)\n", cont);
+            // Replies can move the driver's setup on; once input is flowing, writes are rumble updates
             if (controllers[cont])
-                controllers[cont]->requestReport(HID_REQUEST_READ, buffer, sizeof(buffer));
+                controllers[cont]->completeRequest(HID_REQUEST_WRITE);
             break;
 
         case 0x0C: // Reply to feature request
-            LOG("  Feature request reply (slot %d)\n", cont);
+            LOG_DEBUG(LOG_BT, "  Feature request reply (slot %d)\n", cont);
             if (controllers[cont])
-                controllers[cont]->requestReport(HID_REQUEST_READ, buffer, sizeof(buffer));
+                controllers[cont]->completeRequest(HID_REQUEST_FEATURE);
             break;
     }
 
+    // Have the callback thread look at setup timeouts and deferred reads that may have changed, save anything new about
+    // devices, and install or remove hooks for controllers that came or went, outside of this event
+    if (DeviceCache::isDirty() || event.id == 0x05 || event.id == 0x06 ||
+        (controllers[cont] && controllers[cont]->needsPoll()))
+        ksceKernelSetEventFlag(eventFlagUid, FLAG_POLL);
+
     return 0;
 }
 
@@ -463,9 +793,31 @@ static int callbackThread(SceSize args, void *argp)
 
     while (true)
     {
-        // Idle and handle callbacks until the exit flag is set
+        // Write the device cache back if it changed; this only happens when devices connect or change mode
+        if (DeviceCache::isDirty())
+            DeviceCache::save();
+
+        // Match the installed hooks to the connected controllers, let controllers send reads that were put off and
+        // retry setup steps, and find out when any of that needs to happen again
+        SceUInt timeout = 0;
+        uint64_t now = ksceKernelGetSystemTimeWide();
+        uint64_t hookTime = updateHooks(now);
+        if (hookTime)
+            timeout = (hookTime > now) ? (hookTime - now) : 1;
+        for (int i = 0; i < MAX_CONTROLLERS; i++)
+        {
+            uint64_t wakeTime = controllers[i] ? controllers[i]->poll(now) : 0;
+            if (!wakeTime)
+                continue;
+            SceUInt wait = (wakeTime > now) ? (wakeTime - now) : 1;
+            if (!timeout || wait < timeout)
+                timeout = wait;
+        }
+
+        // Idle and handle callbacks until the exit flag is set, waking up when a controller needs it
         uint32_t outBits;
-        int ret = ksceKernelWaitEventFlagCB(eventFlagUid, FLAG_EXIT, SCE_EVENT_WAITOR | SCE_EVENT_WAITCLEAR_PAT, &outBits, nullptr);
+        int ret = ksceKernelWaitEventFlagCB(eventFlagUid, FLAG_EXIT | FLAG_POLL, SCE_EVENT_WAITOR | SCE_EVENT_WAITCLEAR_PAT,
+            &outBits, timeout ? &timeout : nullptr);
         if (ret >= 0 && (outBits & FLAG_EXIT))
             break;
     }
@@ -480,96 +832,111 @@ static int callbackThread(SceSize args, void *argp)
 extern "C"
 {
 
-int moduleStart(SceSize args, void *argp)
+int vitacontrolSetRawLog(int mode)
 {
-    LOG("=== VitaControl starting ===\n");
-
-    // File logging disabled for performance - eliminates buffer comparison and I/O overhead on every input.
-    // Uncomment below to re-enable for diagnostics / mapping sessions.
-    /*
-    g_logFd = ksceIoOpen("ux0:data/vitacontrol_mapper_raw.txt",
-        SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0666);
-    if (g_logFd < 0)
-    {
-        LOG("Failed to open ux0:data/vitacontrol_mapper_raw.txt (%d)\n", g_logFd);
-        g_logFd = ksceIoOpen("ur0:data/vitacontrol_mapper_raw.txt",
-            SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0666);
-        if (g_logFd >= 0)
-            LOG("Logging to ur0:data/vitacontrol_mapper_raw.txt\n");
-    }
-    else
+    uint32_t state;
+    ENTER_SYSCALL(state);
+    RawLog::setMode(mode);
+    EXIT_SYSCALL(state);
+    return 0;
+}
+
+int vitacontrolSetCapture(int enabled)
+{
+    uint32_t state;
+    ENTER_SYSCALL(state);
+    int res = Capture::setEnabled(enabled != 0);
+    EXIT_SYSCALL(state);
+    return res;
+}
+
+int vitacontrolReadCapture(VitacontrolCaptureRecord *records, int count, unsigned int timeout)
+{
+    uint32_t state;
+    ENTER_SYSCALL(state);
+    int res = Capture::read(records, count, timeout);
+    EXIT_SYSCALL(state);
+    return res;
+}
+
+int vitacontrolGetStats(VitacontrolStats *stats)
+{
+    uint32_t state;
+    ENTER_SYSCALL(state);
+
+    // Fill in the counters kept elsewhere, then hand out a copy
+    Stats::stats.time = ksceKernelGetSystemTimeWide();
+    Stats::stats.rawLogDropped = RawLog::getDropped();
+    Stats::stats.captureDropped = Capture::getDropped();
+    for (int i = 0; i < MAX_CONTROLLERS; i++)
     {
-        LOG("Logging to ux0:data/vitacontrol_mapper_raw.txt\n");
+        if (controllers[i])
+            Stats::stats.slots[i].droppedReports = controllers[i]->getDroppedReports();
     }
-    */
+    int res = ksceKernelMemcpyKernelToUser(stats, &Stats::stats, sizeof(VitacontrolStats));
+
+    EXIT_SYSCALL(state);
+    return res;
+}
+
+int vitacontrolSetLogLevel(int category, int level)
+{
+    uint32_t state;
+    ENTER_SYSCALL(state);
+    Log::setLevel(category, level);
+    EXIT_SYSCALL(state);
+    return 0;
+}
+
+int moduleStart(SceSize args, void *argp)
+{
+    LOG_INFO(LOG_CORE, "=== VitaControl starting ===\n");
 
     tai_module_info_t modInfo;
     modInfo.size = sizeof(tai_module_info_t);
 
     if (taiGetModuleInfoForKernel(KERNEL_PID, "SceBt", &modInfo) < 0)
     {
-        LOG("Failed to get SceBt module info\n");
+        LOG_ERROR(LOG_CORE, "Failed to get SceBt module info\n");
         return SCE_KERNEL_START_FAILED;
     }
 
     // Hook bluetooth functions
     BIND_FUNC_OFFSET_HOOK(sceBt0x22999C8, KERNEL_PID, modInfo.modid, 0, 0x22999C8 - 0x2280000, 1);
 
-    // Hook controller info functions
-    BIND_FUNC_EXPORT_HOOK(ksceCtrlGetControllerPortInfo, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0xF11D0D30);
-    BIND_FUNC_EXPORT_HOOK(sceCtrlGetBatteryInfo,         KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x8F9B1CE5);
-
+    // The rest of the hooks are installed by the callback thread while controllers that use them are connected, and
+    // some of them are found by offset in SceCtrl
     if (taiGetModuleInfoForKernel(KERNEL_PID, "SceCtrl", &modInfo) < 0)
     {
-        LOG("Failed to get SceCtrl module info\n");
+        LOG_ERROR(LOG_CORE, "Failed to get SceCtrl module info\n");
         return SCE_KERNEL_START_FAILED;
     }
+    ctrlModid = modInfo.modid;
 
-    // Hook control data functions
-    BIND_FUNC_EXPORT_HOOK(ksceCtrlPeekBufferPositive, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0xEA1D3A34);
-    BIND_FUNC_EXPORT_HOOK(ksceCtrlReadBufferPositive, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x9B96A1AA);
-    BIND_FUNC_EXPORT_HOOK(ksceCtrlPeekBufferNegative, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x19895843);
-    BIND_FUNC_EXPORT_HOOK(ksceCtrlReadBufferNegative, KERNEL_PID, "SceCtrl", TAI_ANY_LIBRARY, 0x8D4E0DD1);
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferPositiveExt,  KERNEL_PID, modInfo.modid, 0, 0x3928 | 1, 1);
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferPositiveExt,  KERNEL_PID, modInfo.modid, 0, 0x3BCC | 1, 1);
-
-    // Hook extended control data functions
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferPositive2,    KERNEL_PID, modInfo.modid, 0, 0x3EF8 | 1, 1);
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferPositive2,    KERNEL_PID, modInfo.modid, 0, 0x449C | 1, 1);
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferNegative2,    KERNEL_PID, modInfo.modid, 0, 0x41C8 | 1, 1);
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferNegative2,    KERNEL_PID, modInfo.modid, 0, 0x47F0 | 1, 1);
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlPeekBufferPositiveExt2, KERNEL_PID, modInfo.modid, 0, 0x4B48 | 1, 1);
-    BIND_FUNC_OFFSET_HOOK(ksceCtrlReadBufferPositiveExt2, KERNEL_PID, modInfo.modid, 0, 0x4E14 | 1, 1);
-
-    // Hook touch data functions
-    BIND_FUNC_EXPORT_HOOK(ksceTouchPeek,       KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0xBAD1960B);
-    BIND_FUNC_EXPORT_HOOK(ksceTouchPeekRegion, KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0x9B3F7207);
-    BIND_FUNC_EXPORT_HOOK(ksceTouchRead,       KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0x70C8AACE);
-    BIND_FUNC_EXPORT_HOOK(ksceTouchReadRegion, KERNEL_PID, "SceTouch", TAI_ANY_LIBRARY, 0x9A91F624);
-
-    // Hook motion state functions
-    BIND_FUNC_EXPORT_HOOK(sceMotionGetState, KERNEL_PID, "SceMotion", TAI_ANY_LIBRARY, 0xBDB32767);
-
+    // Title profiles are allocated from the pool, and switched by process events from then on
     Mempool::init();
-
-    // Prepare the event flag and callback thread
+    Config::load();
+    Profiles::init();
+    DeviceCache::load();
+    RawLog::init();
+    Capture::init();
+
+    // Prepare the event flag and callback thread, with room on its stack for installing hooks through taiHEN and
+    // saving the device cache on top of handling bluetooth events
     eventFlagUid = ksceKernelCreateEventFlag("vitacontrol_eventflag", 0, 0, nullptr);
-    threadUid = ksceKernelCreateThread("vitacontrol_thread", callbackThread, 0x3C, 0x1000, 0, 0x10000, 0);
+    threadUid = ksceKernelCreateThread("vitacontrol_thread", callbackThread, 0x3C, CALLBACK_STACK_SIZE, 0, 0x10000, 0);
     ksceKernelStartThread(threadUid, 0, nullptr);
 
-    LOG("=== VitaControl started successfully ===\n");
+    LOG_INFO(LOG_CORE, "=== VitaControl started successfully ===\n");
     return SCE_KERNEL_START_SUCCESS;
 }
 
 int moduleStop(SceSize args, void *argp)
 {
-    LOG("=== VitaControl stopping ===\n");
+    LOG_INFO(LOG_CORE, "=== VitaControl stopping ===\n");
 
-    if (g_logFd >= 0)
-    {
-        ksceIoClose(g_logFd);
-        g_logFd = -1;
-    }
+    Capture::deinit();
+    RawLog::deinit();
 
     // Set the exit flag to stop the callback thread
     if (eventFlagUid > 0)
@@ -601,39 +968,14 @@ int moduleStop(SceSize args, void *argp)
         }
     }
 
+    Profiles::deinit();
     Mempool::deinit();
 
     // Unhook bluetooth functions
     UNBIND_FUNC_HOOK(sceBt0x22999C8);
 
-    // Unhook controller info functions
-    UNBIND_FUNC_HOOK(ksceCtrlGetControllerPortInfo);
-    UNBIND_FUNC_HOOK(sceCtrlGetBatteryInfo);
-
-    // Unhook control data functions
-    UNBIND_FUNC_HOOK(ksceCtrlReadBufferNegative);
-    UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositive);
-    UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositive);
-    UNBIND_FUNC_HOOK(ksceCtrlPeekBufferNegative);
-    UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositiveExt);
-    UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositiveExt);
-
-    // Unhook extended control data functions
-    UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositive2);
-    UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositive2);
-    UNBIND_FUNC_HOOK(ksceCtrlPeekBufferNegative2);
-    UNBIND_FUNC_HOOK(ksceCtrlReadBufferNegative2);
-    UNBIND_FUNC_HOOK(ksceCtrlPeekBufferPositiveExt2);
-    UNBIND_FUNC_HOOK(ksceCtrlReadBufferPositiveExt2);
-
-    // Unhook touch data functions
-    UNBIND_FUNC_HOOK(ksceTouchPeek);
-    UNBIND_FUNC_HOOK(ksceTouchPeekRegion);
-    UNBIND_FUNC_HOOK(ksceTouchRead);
-    UNBIND_FUNC_HOOK(ksceTouchReadRegion);
-
-    // Unhook motion state functions
-    UNBIND_FUNC_HOOK(sceMotionGetState);
+    // Unhook whatever is still installed
+    unbindHooks(hookGroups);
 
     return SCE_KERNEL_STOP_SUCCESS;
 }
@@ -0,0 +1,43 @@
+#include <cstring>
+
+#include "config.h"
+#include "polling.h"
+
+// Built-in settings, in milliseconds: time between power ticks, time without changes before a controller is idle
+// (0 to never slow down), and time between reads of an idle controller
+#define DEFAULT_TICK_INTERVAL 1000
+#define DEFAULT_IDLE_TIMEOUT  5000
+#define DEFAULT_IDLE_INTERVAL 50
+
+// Intervals in microseconds, ready to compare with system times
+static uint32_t tickInterval = DEFAULT_TICK_INTERVAL * 1000;
+static uint32_t idleTimeout  = DEFAULT_IDLE_TIMEOUT  * 1000;
+static uint32_t idleInterval = DEFAULT_IDLE_INTERVAL * 1000;
+
+bool Polling::setOption(const char *key, const char *value)
+{
+    int number;
+    if (!Config::parseInt(value, &number) || number < 0)
+        return false;
+
+    if (strcmp(key, "power_tick") == 0 && number <= 60000)
+        tickInterval = number * 1000;
+    else if (strcmp(key, "idle_timeout") == 0 && number <= 600000)
+        idleTimeout = number * 1000;
+    else if (strcmp(key, "idle_interval") == 0 && number >= 1 && number <= 1000)
+        idleInterval = number * 1000;
+    else
+        return false;
+    return true;
+}
+
+uint32_t Polling::getTickInterval()
+{
+    return tickInterval;
+}
+
+uint32_t Polling::getReadDelay(uint64_t idleTime)
+{
+    // Read again right away unless the controller has been left alone for long enough
+    return (idleTimeout && idleTime >= idleTimeout) ? idleInterval : 0;
+}
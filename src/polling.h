@@ -0,0 +1,18 @@
+#ifndef POLLING_H
+#define POLLING_H
+
+#include <stdint.h>
+
+// Input polling and power ticks. Inputs keep the Vita awake with at most one power tick per interval, and controllers
+// whose input hasn't changed for a while are read less often until it does. Settings come from the [polling] section
+// in the config file, which always applies to every controller and title.
+namespace Polling
+{
+
+bool setOption(const char *key, const char *value);
+uint32_t getTickInterval();
+uint32_t getReadDelay(uint64_t idleTime);
+
+};
+
+#endif // POLLING_H
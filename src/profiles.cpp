@@ -0,0 +1,130 @@
+#include <cstring>
+#include <psp2kern/kernel/processmgr.h>
+
+#include "log.h"
+#include "mempool.h"
+#include "profiles.h"
+
+static Profile defaultProfile;
+static Profile *profiles[MAX_PROFILES];
+static int profileCount = 0;
+
+// The profile each slot is using, replaced whole when the running title changes
+static const PortProfile *volatile activePorts[MAX_PORTS] =
+{
+    &defaultProfile.ports[0], &defaultProfile.ports[1], &defaultProfile.ports[2], &defaultProfile.ports[3]
+};
+
+static SceUID eventHandlerUid = -1;
+static SceUID activePid = -1;
+
+static int processCreated(SceUID pid, SceProcEventInvokeParam2 *param, int unk)
+{
+    char titleId[TITLE_ID_SIZE];
+    if (ksceKernelGetProcessTitleId(pid, titleId, sizeof(titleId)) < 0)
+        return 0;
+
+    // System apps (such as the home screen) keep whatever profile the last game was using
+    if (strncmp(titleId, "NPXS", 4) == 0)
+        return 0;
+
+    activePid = pid;
+    Profiles::activate(titleId);
+    return 0;
+}
+
+static int processExited(SceUID pid, SceProcEventInvokeParam1 *param, int unk)
+{
+    // Go back to the default profile when the title that chose the current one closes
+    if (pid == activePid)
+    {
+        activePid = -1;
+        Profiles::activate(nullptr);
+    }
+    return 0;
+}
+
+void Profiles::init()
+{
+    // Watch for applications starting and closing
+    static SceProcEventHandler handler = {};
+    handler.size   = sizeof(SceProcEventHandler);
+    handler.create = processCreated;
+    handler.exit   = processExited;
+    handler.kill   = processExited;
+    eventHandlerUid = ksceKernelRegisterProcEventHandler("vitacontrol_profiles", &handler, 0);
+    if (eventHandlerUid < 0)
+        LOG_ERROR(LOG_CORE, "Failed to register process event handler: 0x%08X\n", eventHandlerUid);
+}
+
+void Profiles::deinit()
+{
+    if (eventHandlerUid >= 0)
+    {
+        ksceKernelUnregisterProcEventHandler(eventHandlerUid);
+        eventHandlerUid = -1;
+    }
+
+    // Nothing can be reading title profiles once the default is back in place
+    activate(nullptr);
+    for (int i = 0; i < profileCount; i++)
+        Mempool::free(profiles[i]);
+    profileCount = 0;
+}
+
+Profile *Profiles::getDefault()
+{
+    return &defaultProfile;
+}
+
+Profile *Profiles::add(const char *titleId)
+{
+    // Titles named more than once share a profile
+    for (int i = 0; i < profileCount; i++)
+    {
+        if (strcmp(profiles[i]->titleId, titleId) == 0)
+            return profiles[i];
+    }
+
+    if (profileCount == MAX_PROFILES || strlen(titleId) >= TITLE_ID_SIZE)
+        return nullptr;
+
+    Profile *profile = (Profile*)Mempool::alloc(sizeof(Profile));
+    if (!profile)
+        return nullptr;
+
+    strcpy(profile->titleId, titleId);
+    profiles[profileCount++] = profile;
+    return profile;
+}
+
+int Profiles::getCount()
+{
+    return profileCount;
+}
+
+Profile *Profiles::get(int index)
+{
+    return profiles[index];
+}
+
+void Profiles::activate(const char *titleId)
+{
+    // Use the title's own profile if it has one, or the default otherwise
+    const Profile *profile = &defaultProfile;
+    for (int i = 0; titleId && i < profileCount; i++)
+    {
+        if (strcmp(profiles[i]->titleId, titleId) == 0)
+            profile = profiles[i];
+    }
+
+    for (int i = 0; i < MAX_PORTS; i++)
+        activePorts[i] = &profile->ports[i];
+
+    LOG_INFO(LOG_CORE, "Using %s settings profile\n", (profile == &defaultProfile) ? "default" : profile->titleId);
+}
+
+const PortProfile *Profiles::getPort(int port)
+{
+    return activePorts[port];
+}
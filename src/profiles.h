@@ -0,0 +1,45 @@
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include "gyro_aim.h"
+#include "remap.h"
+#include "sticks.h"
+
+// Space for a title ID (such as PCSB00245), and most titles that can have their own settings
+#define TITLE_ID_SIZE 32
+#define MAX_PROFILES  16
+
+// Compiled settings for one controller slot
+struct PortProfile
+{
+    StickTables sticks;
+    AimTables gyro;
+    RemapTables remap;
+};
+
+// Compiled settings for every slot, used while a title is running (or while anything else is, for the default)
+struct Profile
+{
+    char titleId[TITLE_ID_SIZE];
+    PortProfile ports[MAX_PORTS];
+};
+
+// Per-title settings. Every profile is compiled when the config is loaded, and when an application starts, each
+// slot is switched to its profile with a single pointer write, so reports being decoded never wait on anything.
+namespace Profiles
+{
+
+void init();
+void deinit();
+
+Profile *getDefault();
+Profile *add(const char *titleId);
+int getCount();
+Profile *get(int index);
+
+void activate(const char *titleId);
+const PortProfile *getPort(int port);
+
+};
+
+#endif // PROFILES_H
@@ -0,0 +1,402 @@
+#include <psp2kern/io/fcntl.h>
+#include <psp2kern/kernel/threadmgr.h>
+
+#include "log.h"
+#include "raw_log.h"
+#include "../include/vitacontrol.h"
+#include "../include/vitacontrol_rawlog.h"
+
+#define MAX_SLOTS VCRL_MAX_SLOTS
+
+// Queued records (must be a power of 2), and how many bytes of each report are kept
+#define RECORD_COUNT 256
+#define REPORT_SIZE  VCRL_MAX_REPORT
+
+// Bytes of each report included in text lines (the mapper parses 2-digit indices)
+#define TEXT_REPORT_SIZE 64
+
+// Size of the block that formatted lines are collected in, and when it gets written out
+#define BLOCK_SIZE      0x4000
+#define BLOCK_THRESHOLD 0x3000
+#define FLUSH_INTERVAL  250000
+
+// How often the flusher thread wakes up to drain the queue, in microseconds
+#define DRAIN_INTERVAL 100000
+
+#define FLAG_EXIT (1 << 0)
+
+struct Record
+{
+    uint64_t time;
+    uint32_t device;
+    uint8_t slot;
+    uint8_t length;
+    uint8_t data[REPORT_SIZE];
+};
+
+struct SlotState
+{
+    bool hasLast;
+    uint8_t last[TEXT_REPORT_SIZE];
+};
+
+volatile int RawLog::mode = VITACONTROL_RAWLOG_OFF;
+
+// Single-producer single-consumer queue: only the bluetooth callback writes, only the flusher thread reads
+static Record records[RECORD_COUNT];
+static volatile uint32_t writeIndex = 0;
+static volatile uint32_t readIndex = 0;
+static volatile uint32_t dropped = 0;
+
+// VID and PID of the device connected to each slot, stamped on its records
+static volatile uint32_t devices[MAX_SLOTS];
+
+// State owned by the flusher thread
+static SlotState slotStates[MAX_SLOTS];
+static VcrlSlot binaryStates[MAX_SLOTS];
+static uint64_t binaryTime = 0;
+static char block[BLOCK_SIZE];
+static size_t blockSize = 0;
+static uint32_t droppedLogged = 0;
+static uint32_t devicesLogged[MAX_SLOTS];
+static int lastTextSlot = -1;
+static SceUID logFd = -1;
+static int logMode = VITACONTROL_RAWLOG_OFF;
+
+static SceUID eventFlagUid = -1;
+static SceUID threadUid = -1;
+
+static inline void appendHex2(char *&p, unsigned v)
+{
+    static const char *hex = "0123456789ABCDEF";
+    *p++ = hex[(v >> 4) & 0xF];
+    *p++ = hex[(v >> 0) & 0xF];
+}
+
+static inline void appendStr(char *&p, const char *s)
+{
+    while (*s) *p++ = *s++;
+}
+
+static inline void appendDec(char *&p, uint32_t v)
+{
+    char digits[10];
+    int count = 0;
+    do { digits[count++] = '0' + (v % 10); v /= 10; } while (v);
+    while (count) *p++ = digits[--count];
+}
+
+static void openLog(int mode)
+{
+    const char *name = (mode == VITACONTROL_RAWLOG_BINARY) ? "vitacontrol_raw.bin" : "vitacontrol_mapper_raw.txt";
+    char path[64];
+    char *p = path;
+
+    // Try ux0 first, and fall back to ur0 if it's not available
+    appendStr(p, "ux0:data/");
+    appendStr(p, name);
+    *p = '\0';
+    logFd = ksceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0666);
+    if (logFd < 0)
+    {
+        LOG_WARN(LOG_RAWLOG, "Failed to open %s (%d)\n", path, logFd);
+        path[1] = 'r';
+        logFd = ksceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0666);
+    }
+    if (logFd >= 0)
+        LOG_INFO(LOG_RAWLOG, "Logging to %s\n", path);
+
+    // Start each log with fresh baselines
+    for (int i = 0; i < MAX_SLOTS; i++)
+    {
+        slotStates[i].hasLast = false;
+        binaryStates[i].valid = 0;
+        devicesLogged[i] = 0;
+    }
+    lastTextSlot = -1;
+    binaryTime = 0;
+    blockSize = 0;
+    logMode = mode;
+
+    // Binary logs start with a header identifying the format
+    if (mode == VITACONTROL_RAWLOG_BINARY)
+        blockSize = vcrlPutHeader((uint8_t*)block) - (uint8_t*)block;
+}
+
+static void flushBlock()
+{
+    if (logFd >= 0 && blockSize > 0)
+        ksceIoWrite(logFd, block, blockSize);
+    blockSize = 0;
+}
+
+static void closeLog()
+{
+    flushBlock();
+    if (logFd >= 0)
+    {
+        ksceIoClose(logFd);
+        logFd = -1;
+    }
+    logMode = VITACONTROL_RAWLOG_OFF;
+}
+
+static void encodeRecord(const Record &record)
+{
+    // Make sure a worst-case record fits in the block, along with a device record
+    if (blockSize > BLOCK_SIZE - VCRL_MAX_RECORD * 2)
+        flushBlock();
+
+    // Say which device the slot's reports come from when it changes
+    if (record.device != devicesLogged[record.slot])
+    {
+        uint8_t *end = vcrlPutDevice((uint8_t*)&block[blockSize], record.slot, record.time - binaryTime,
+            record.device >> 16, record.device & 0xFFFF);
+        blockSize = (char*)end - block;
+        binaryTime = record.time;
+        devicesLogged[record.slot] = record.device;
+    }
+
+    // Encode the report as XORed runs of changed bytes, timed relative to the previous record
+    uint8_t *end = vcrlEncodeReport((uint8_t*)&block[blockSize], record.slot, record.time - binaryTime,
+        &binaryStates[record.slot], record.data, record.length);
+    blockSize = (char*)end - block;
+    binaryTime = record.time;
+}
+
+static void formatRecord(const Record &record)
+{
+    size_t maxBytes = (record.length > TEXT_REPORT_SIZE) ? TEXT_REPORT_SIZE : record.length;
+    SlotState &st = slotStates[record.slot];
+
+    if (!st.hasLast)
+    {
+        for (size_t i = 0; i < maxBytes; i++)
+            st.last[i] = record.data[i];
+        st.hasLast = true;
+        return; // don't write a line until we have a delta (keeps file clean for mapper)
+    }
+
+    bool any = false;
+    for (size_t i = 0; i < maxBytes; i++)
+    {
+        if (st.last[i] != record.data[i]) { any = true; break; }
+    }
+    if (!any) return;
+
+    // Format (parseable by mapper): id=.. b1=.. b2=.. b3=.. b4=.. b5=.. b6=.. b7=.. ch=[idx:old>new,...]\n
+    // A full line is at most 256 bytes, so make room for one first
+    if (blockSize > BLOCK_SIZE - 256 - 48)
+        flushBlock();
+
+    const uint8_t *buf = record.data;
+    char *p = &block[blockSize];
+
+    // Lines don't carry a slot, so say which slot and device the following lines are from whenever that changes
+    if (record.slot != lastTextSlot || record.device != devicesLogged[record.slot])
+    {
+        appendStr(p, "# device slot=");
+        appendDec(p, record.slot);
+        appendStr(p, " vid=");
+        appendHex2(p, record.device >> 24);
+        appendHex2(p, record.device >> 16);
+        appendStr(p, " pid=");
+        appendHex2(p, record.device >> 8);
+        appendHex2(p, record.device);
+        *p++ = '\n';
+        lastTextSlot = record.slot;
+        devicesLogged[record.slot] = record.device;
+    }
+
+    appendStr(p, "id=");
+    appendHex2(p, buf[0]);
+    if (maxBytes >= 8)
+    {
+        appendStr(p, " b1="); appendHex2(p, buf[1]);
+        appendStr(p, " b2="); appendHex2(p, buf[2]);
+        appendStr(p, " b3="); appendHex2(p, buf[3]);
+        appendStr(p, " b4="); appendHex2(p, buf[4]);
+        appendStr(p, " b5="); appendHex2(p, buf[5]);
+        appendStr(p, " b6="); appendHex2(p, buf[6]);
+        appendStr(p, " b7="); appendHex2(p, buf[7]);
+    }
+    appendStr(p, " ch=[");
+    bool first = true;
+    for (size_t i = 0; i < maxBytes; i++)
+    {
+        if (st.last[i] == buf[i]) continue;
+        if (!first) *p++ = ',';
+        if (i >= 10) *p++ = (char)('0' + (i / 10));
+        *p++ = (char)('0' + (i % 10));
+        *p++ = ':';
+        appendHex2(p, st.last[i]);
+        *p++ = '>';
+        appendHex2(p, buf[i]);
+        first = false;
+    }
+    *p++ = ']';
+    *p++ = '\n';
+    blockSize = p - block;
+
+    // update baseline
+    for (size_t i = 0; i < maxBytes; i++)
+        st.last[i] = buf[i];
+}
+
+static void drainRecords()
+{
+    // Format everything that was queued since the last drain
+    uint32_t end = writeIndex;
+    __sync_synchronize();
+    uint32_t index = readIndex;
+
+    for (; index != end; index++)
+    {
+        if (logFd < 0)
+            continue;
+        if (logMode == VITACONTROL_RAWLOG_BINARY)
+            encodeRecord(records[index & (RECORD_COUNT - 1)]);
+        else
+            formatRecord(records[index & (RECORD_COUNT - 1)]);
+    }
+
+    // Hand the records back to the producer
+    __sync_synchronize();
+    readIndex = index;
+
+    // Note any records that were dropped because the queue was full (mapper skips lines starting with #)
+    uint32_t count = dropped;
+    if (count != droppedLogged && logFd >= 0 && logMode == VITACONTROL_RAWLOG_TEXT)
+    {
+        if (blockSize > BLOCK_SIZE - 32)
+            flushBlock();
+        char *p = &block[blockSize];
+        appendStr(p, "# dropped=");
+        appendDec(p, count);
+        *p++ = '\n';
+        blockSize = p - block;
+        droppedLogged = count;
+    }
+
+    // Binary logs get the number dropped since the last note, at the time of the last record
+    if (count != droppedLogged && logFd >= 0 && logMode == VITACONTROL_RAWLOG_BINARY)
+    {
+        if (blockSize > BLOCK_SIZE - VCRL_MAX_RECORD)
+            flushBlock();
+        uint8_t *end = vcrlPutDropped((uint8_t*)&block[blockSize], 0, count - droppedLogged);
+        blockSize = (char*)end - block;
+        droppedLogged = count;
+    }
+}
+
+static int flusherThread(SceSize args, void *argp)
+{
+    uint64_t lastFlush = 0;
+
+    while (true)
+    {
+        // Sleep until the next drain, or until the exit flag is set
+        uint32_t outBits = 0;
+        SceUInt timeout = DRAIN_INTERVAL;
+        ksceKernelWaitEventFlag(eventFlagUid, FLAG_EXIT, SCE_EVENT_WAITOR | SCE_EVENT_WAITCLEAR_PAT, &outBits, &timeout);
+        if (outBits & FLAG_EXIT)
+            break;
+
+        // Open or close the log file when logging is switched on or off, or to another format
+        int mode = RawLog::mode;
+        if (mode != logMode && logFd >= 0)
+            closeLog();
+        if (mode != VITACONTROL_RAWLOG_OFF && logFd < 0)
+            openLog(mode);
+
+        drainRecords();
+
+        // Write in large blocks, but don't hold on to a partial block for too long
+        uint64_t now = ksceKernelGetSystemTimeWide();
+        if (blockSize >= BLOCK_THRESHOLD || (blockSize > 0 && now - lastFlush >= FLUSH_INTERVAL))
+        {
+            flushBlock();
+            lastFlush = now;
+        }
+    }
+
+    drainRecords();
+    closeLog();
+    return 0;
+}
+
+void RawLog::init()
+{
+    // Prepare the event flag and a low-priority thread for writing the log
+    eventFlagUid = ksceKernelCreateEventFlag("vitacontrol_rawlog_flag", 0, 0, nullptr);
+    threadUid = ksceKernelCreateThread("vitacontrol_rawlog_thread", flusherThread, 0xA0, 0x2000, 0, 0x10000, 0);
+    ksceKernelStartThread(threadUid, 0, nullptr);
+}
+
+void RawLog::deinit()
+{
+    mode = VITACONTROL_RAWLOG_OFF;
+
+    // Set the exit flag to stop the flusher thread, which writes anything left over
+    if (eventFlagUid > 0)
+        ksceKernelSetEventFlag(eventFlagUid, FLAG_EXIT);
+
+    // Wait for the flusher thread to stop and clean it up
+    if (threadUid > 0)
+    {
+        ksceKernelWaitThreadEnd(threadUid, nullptr, nullptr);
+        ksceKernelDeleteThread(threadUid);
+        threadUid = -1;
+    }
+
+    // Clean up the event flag
+    if (eventFlagUid > 0)
+    {
+        ksceKernelDeleteEventFlag(eventFlagUid);
+        eventFlagUid = -1;
+    }
+}
+
+void RawLog::setMode(int newMode)
+{
+    // The flusher thread opens or closes the file on its next wake-up
+    if (newMode >= VITACONTROL_RAWLOG_OFF && newMode <= VITACONTROL_RAWLOG_BINARY)
+        mode = newMode;
+}
+
+void RawLog::push(int slot, const uint8_t *buffer, size_t length)
+{
+    if (slot < 0 || slot >= MAX_SLOTS || !buffer || length < 1)
+        return;
+
+    // Drop the record if the flusher thread has fallen behind, rather than waiting
+    uint32_t index = writeIndex;
+    if (index - readIndex >= RECORD_COUNT)
+    {
+        dropped = dropped + 1;
+        return;
+    }
+
+    // Fill the record, then publish it
+    Record &record = records[index & (RECORD_COUNT - 1)];
+    record.time   = ksceKernelGetSystemTimeWide();
+    record.device = devices[slot];
+    record.slot   = slot;
+    record.length = (length > REPORT_SIZE) ? REPORT_SIZE : length;
+    for (size_t i = 0; i < record.length; i++)
+        record.data[i] = buffer[i];
+
+    __sync_synchronize();
+    writeIndex = index + 1;
+}
+
+uint32_t RawLog::getDropped()
+{
+    return dropped;
+}
+
+void RawLog::setDevice(int slot, uint16_t vid, uint16_t pid)
+{
+    if (slot >= 0 && slot < MAX_SLOTS)
+        devices[slot] = (vid << 16) | pid;
+}
@@ -0,0 +1,29 @@
+#ifndef RAW_LOG_H
+#define RAW_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw input report logging for mapping sessions and field diagnostics.
+// Reports are queued by the bluetooth callback without blocking, and a low-priority thread formats and writes them.
+namespace RawLog
+{
+
+extern volatile int mode;
+
+void init();
+void deinit();
+
+void setMode(int newMode);
+void push(int slot, const uint8_t *buffer, size_t length);
+void setDevice(int slot, uint16_t vid, uint16_t pid);
+uint32_t getDropped();
+
+inline bool isEnabled()
+{
+    return mode != 0;
+}
+
+};
+
+#endif // RAW_LOG_H
@@ -0,0 +1,174 @@
+#include <cstring>
+
+#include "config.h"
+#include "remap.h"
+
+// Built-in turbo rate, in presses per second, and the range allowed
+#define DEFAULT_TURBO_RATE 10
+#define MIN_TURBO_RATE     1
+#define MAX_TURBO_RATE     30
+
+struct RemapSettings
+{
+    uint32_t targets[32];
+    uint32_t turbo;
+    uint32_t toggle;
+    int turboRate;
+};
+
+struct RemapState
+{
+    const RemapTables *tables;
+    uint32_t previous;
+    uint32_t latched;
+    bool turboHeld;
+    bool turboOn;
+    uint64_t turboTime;
+};
+
+static RemapSettings settings[MAX_PORTS];
+static RemapState states[MAX_PORTS];
+
+void Remap::reset()
+{
+    for (int i = 0; i < MAX_PORTS; i++)
+    {
+        RemapSettings &s = settings[i];
+        for (int j = 0; j < 32; j++)
+            s.targets[j] = 1u << j;
+        s.turbo = 0;
+        s.toggle = 0;
+        s.turboRate = DEFAULT_TURBO_RATE;
+    }
+}
+
+static bool setPortOption(RemapSettings &s, const char *key, const char *value)
+{
+    // Turbo and toggle take the output buttons they apply to
+    if (strcmp(key, "turbo") == 0)
+        return Config::parseButtons(value, &s.turbo);
+    if (strcmp(key, "toggle") == 0)
+        return Config::parseButtons(value, &s.toggle);
+
+    if (strcmp(key, "turbo_rate") == 0)
+    {
+        int rate;
+        if (!Config::parseInt(value, &rate) || rate < MIN_TURBO_RATE || rate > MAX_TURBO_RATE)
+            return false;
+        s.turboRate = rate;
+        return true;
+    }
+
+    // Anything else is a single button, sent as the buttons in the value
+    uint32_t source, targets;
+    if (!Config::parseButtons(key, &source) || !source || (source & (source - 1)))
+        return false;
+    if (!Config::parseButtons(value, &targets))
+        return false;
+
+    int bit = 0;
+    while (!(source & (1u << bit))) bit++;
+    s.targets[bit] = targets;
+    return true;
+}
+
+bool Remap::setOption(const char *port, const char *key, const char *value)
+{
+    // "[remap]" applies to every port, and "[remap N]" only to controller N (1-4)
+    if (!*port)
+    {
+        for (int i = 0; i < MAX_PORTS; i++)
+        {
+            if (!setPortOption(settings[i], key, value))
+                return false;
+        }
+        return true;
+    }
+
+    int index;
+    if (!Config::parseInt(port, &index) || index < 1 || index > MAX_PORTS)
+        return false;
+    return setPortOption(settings[index - 1], key, value);
+}
+
+void Remap::compile(int port, RemapTables &t)
+{
+    const RemapSettings &s = settings[port];
+
+    // Skip remapping entirely for ports that wouldn't change anything
+    t.identity = !s.turbo && !s.toggle;
+    for (int j = 0; j < 32; j++)
+    {
+        if (s.targets[j] != (1u << j))
+            t.identity = false;
+    }
+
+    // Each table gives the output buttons for every combination of one byte of input buttons
+    for (int j = 0; j < 4; j++)
+    {
+        for (int value = 0; value < 256; value++)
+        {
+            uint32_t output = 0;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                if (value & (1 << bit))
+                    output |= s.targets[j * 8 + bit];
+            }
+            t.bytes[j][value] = output;
+        }
+    }
+
+    // Turbo switches between pressed and released twice per press
+    t.turbo = s.turbo;
+    t.toggle = s.toggle;
+    t.turboInterval = 500000 / s.turboRate;
+}
+
+void Remap::resetState(int port)
+{
+    memset(&states[port], 0, sizeof(RemapState));
+}
+
+void Remap::apply(const RemapTables &t, int port, uint64_t time, ControlData *data)
+{
+    // Start over when the slot switches to another title's settings, so nothing latched under the old ones stays held
+    RemapState &s = states[port];
+    if (s.tables != &t)
+    {
+        memset(&s, 0, sizeof(RemapState));
+        s.tables = &t;
+    }
+
+    if (t.identity)
+        return;
+
+    uint32_t in = data->buttons;
+    uint32_t out = t.bytes[0][in & 0xFF] | t.bytes[1][(in >> 8) & 0xFF] |
+                   t.bytes[2][(in >> 16) & 0xFF] | t.bytes[3][in >> 24];
+
+    // Toggled buttons flip on each new press, and stay that way until the next one
+    if (t.toggle)
+    {
+        s.latched ^= out & ~s.previous & t.toggle;
+        s.previous = out;
+        out = (out & ~t.toggle) | s.latched;
+    }
+
+    // Turbo buttons start pressed, then alternate for as long as they're held
+    bool held = out & t.turbo;
+    if (held && !s.turboHeld)
+    {
+        s.turboOn = true;
+        s.turboTime = time;
+    }
+    else if (held && time - s.turboTime >= t.turboInterval)
+    {
+        s.turboOn = !s.turboOn;
+        s.turboTime = time;
+    }
+    s.turboHeld = held;
+    if (held && !s.turboOn)
+        out &= ~t.turbo;
+
+    data->buttons = out;
+}
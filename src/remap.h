@@ -0,0 +1,31 @@
+#ifndef REMAP_H
+#define REMAP_H
+
+#include <stdint.h>
+
+#include "controller.h"
+
+// Button remapping shared by all drivers. Each button can be sent as any combination of buttons (or none), and output
+// buttons can repeat while held (turbo) or latch on and off with each press (toggle). Settings come from [remap]
+// sections in the config file, and are compiled into byte lookup tables, so remapping a report takes four table loads.
+struct RemapTables
+{
+    bool identity;
+    uint32_t bytes[4][256];
+    uint32_t turbo;
+    uint32_t toggle;
+    uint32_t turboInterval;
+};
+
+namespace Remap
+{
+
+void reset();
+bool setOption(const char *port, const char *key, const char *value);
+void compile(int port, RemapTables &t);
+void resetState(int port);
+void apply(const RemapTables &t, int port, uint64_t time, ControlData *data);
+
+};
+
+#endif // REMAP_H
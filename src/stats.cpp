@@ -0,0 +1,99 @@
+#include <cstring>
+#include <psp2kern/kernel/threadmgr.h>
+
+#include "stats.h"
+
+#define MAX_SLOTS 4
+
+// Reports to average over before judging whether one is late
+#define LATE_MIN_REPORTS 16
+
+// Longest interval between reports that's measured, in microseconds, so gaps such as a suspend can't overflow the
+// averages (kept in 1/16 microseconds)
+#define MAX_INTERVAL 10000000
+
+VitacontrolStats Stats::stats = {};
+
+// Internal state that isn't part of the snapshot
+static uint32_t lastIntervals[MAX_SLOTS] = {};
+static bool readPending[MAX_SLOTS] = {};
+static uint64_t connectTimes[MAX_SLOTS] = {};
+
+static inline uint32_t bucket(uint32_t time)
+{
+    uint32_t index = time / VITACONTROL_STATS_BUCKET_US;
+    return (index < VITACONTROL_STATS_BUCKETS) ? index : (VITACONTROL_STATS_BUCKETS - 1);
+}
+
+void Stats::connect(int slot, uint64_t time, bool cached)
+{
+    // Start counting from scratch for each new controller
+    memset(&stats.slots[slot], 0, sizeof(VitacontrolSlotStats));
+    stats.slots[slot].connected = 1;
+    stats.slots[slot].cached = cached;
+    connectTimes[slot] = time;
+    lastIntervals[slot] = 0;
+    readPending[slot] = false;
+}
+
+void Stats::disconnect(int slot)
+{
+    stats.slots[slot].connected = 0;
+    readPending[slot] = false;
+}
+
+void Stats::reportReceived(int slot, uint64_t time)
+{
+    VitacontrolSlotStats &s = stats.slots[slot];
+
+    if (s.reports > 0)
+    {
+        uint64_t elapsed = time - s.lastReportTime;
+        uint32_t interval = (elapsed < MAX_INTERVAL) ? elapsed : MAX_INTERVAL;
+        s.intervals[bucket(interval)]++;
+
+        // Count reports that took much longer than usual, as a sign of reports being skipped or delayed
+        if (s.reports >= LATE_MIN_REPORTS && (interval << 4) > s.averageInterval * 2)
+            s.lateReports++;
+
+        // Update the moving averages of the interval and its variation, in 1/16 microseconds
+        int32_t change = (int32_t)interval - (int32_t)lastIntervals[slot];
+        if (change < 0) change = -change;
+        s.averageInterval += ((int32_t)(interval << 4) - (int32_t)s.averageInterval) >> 4;
+        if (s.reports > 1)
+            s.jitter += ((int32_t)(change << 4) - (int32_t)s.jitter) >> 4;
+        lastIntervals[slot] = interval;
+    }
+
+    s.lastReportTime = time;
+    s.reports++;
+    readPending[slot] = true;
+}
+
+void Stats::reportDecoded(int slot, uint32_t duration)
+{
+    VitacontrolSlotStats &s = stats.slots[slot];
+    s.decodeTime += duration;
+    if (duration > s.decodeTimeMax)
+        s.decodeTimeMax = duration;
+}
+
+void Stats::firstInput(int slot, uint64_t time)
+{
+    // Only the first decoded input counts, and it's always at least 1 so it can't look unset
+    VitacontrolSlotStats &s = stats.slots[slot];
+    if (!s.firstInputTime)
+        s.firstInputTime = (time > connectTimes[slot]) ? (time - connectTimes[slot]) : 1;
+}
+
+void Stats::reportRead(int slot)
+{
+    // Measure how long the newest report waited until something read it
+    if (!readPending[slot])
+        return;
+    readPending[slot] = false;
+
+    VitacontrolSlotStats &s = stats.slots[slot];
+    uint32_t latency = ksceKernelGetSystemTimeWide() - s.lastReportTime;
+    s.latencies[bucket(latency)]++;
+}
@@ -0,0 +1,30 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/vitacontrol.h"
+
+// Performance counters exported to companion apps, updated from the bluetooth callback and the hooks.
+// Updates are plain stores without locking; a snapshot can be slightly torn, which is fine for statistics.
+namespace Stats
+{
+
+extern VitacontrolStats stats;
+
+void connect(int slot, uint64_t time, bool cached);
+void disconnect(int slot);
+void reportReceived(int slot, uint64_t time);
+void reportDecoded(int slot, uint32_t duration);
+void firstInput(int slot, uint64_t time);
+void reportRead(int slot);
+
+inline void hookCalled(int hook)
+{
+    stats.hookCalls[hook]++;
+}
+
+};
+
+#endif // STATS_H
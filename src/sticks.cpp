@@ -0,0 +1,283 @@
+#include <cstring>
+
+#include "config.h"
+#include "sticks.h"
+
+// Axis values are 16-bit and centred, so full deflection is 128 << 8
+#define AXIS_SHIFT 8
+#define AXIS_FULL  (128 << AXIS_SHIFT)
+
+// Radial gains have 10 fractional bits
+#define GAIN_SHIFT 10
+#define GAIN_ONE   (1 << GAIN_SHIFT)
+
+// Stick magnitudes are looked up from the top 8 bits of each axis
+#define MAGNITUDE_SIZE 128
+
+// Built-in settings, used for anything the config file doesn't set (all percentages of full deflection)
+#define DEFAULT_DEADZONE      0
+#define DEFAULT_ANTI_DEADZONE 0
+#define DEFAULT_SATURATION    100
+#define DEFAULT_CURVE         0
+#define DEFAULT_CENTER        0x80
+
+struct StickSettings
+{
+    int deadzone;
+    int antiDeadzone;
+    int saturation;
+    int curve;
+};
+
+struct AxisSettings
+{
+    int center;
+    int invert;
+};
+
+struct PortSettings
+{
+    StickSettings sticks[2];
+    AxisSettings axes[4];
+};
+
+static const char *stickNames[] = { "left", "right" };
+static const char *axisNames[] = { "lx", "ly", "rx", "ry" };
+
+static PortSettings settings[MAX_PORTS];
+
+// Rounded magnitude of every pair of whole axis units, shared by all ports
+static uint8_t magnitudes[MAGNITUDE_SIZE][MAGNITUDE_SIZE];
+
+void Sticks::reset()
+{
+    for (int i = 0; i < MAX_PORTS; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            StickSettings &s = settings[i].sticks[j];
+            s.deadzone     = DEFAULT_DEADZONE;
+            s.antiDeadzone = DEFAULT_ANTI_DEADZONE;
+            s.saturation   = DEFAULT_SATURATION;
+            s.curve        = DEFAULT_CURVE;
+        }
+        for (int j = 0; j < 4; j++)
+        {
+            settings[i].axes[j].center = DEFAULT_CENTER;
+            settings[i].axes[j].invert = 0;
+        }
+    }
+}
+
+static uint32_t squareRoot(uint32_t value)
+{
+    // Rounded integer square root, bit by bit
+    uint32_t result = 0;
+    for (uint32_t bit = 1 << 30; bit; bit >>= 2)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+    }
+    return (value > result) ? result + 1 : result;
+}
+
+static bool setStickOption(StickSettings &s, const char *key, int value)
+{
+    if (value < 0 || value > 100)
+        return false;
+
+    if (strcmp(key, "deadzone") == 0)
+        s.deadzone = value;
+    else if (strcmp(key, "anti_deadzone") == 0)
+        s.antiDeadzone = value;
+    else if (strcmp(key, "saturation") == 0 && value > 0)
+        s.saturation = value;
+    else if (strcmp(key, "curve") == 0)
+        s.curve = value;
+    else
+        return false;
+    return true;
+}
+
+static bool setPortOption(PortSettings &s, const char *key, int value)
+{
+    // Options for both sticks have no prefix
+    const char *dot = strchr(key, '.');
+    if (!dot)
+        return setStickOption(s.sticks[0], key, value) && setStickOption(s.sticks[1], key, value);
+
+    // Options for one stick or axis are prefixed with its name
+    size_t length = dot - key;
+    for (int i = 0; i < 2; i++)
+    {
+        if (strlen(stickNames[i]) == length && strncmp(key, stickNames[i], length) == 0)
+            return setStickOption(s.sticks[i], dot + 1, value);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (length != 2 || strncmp(key, axisNames[i], 2) != 0)
+            continue;
+        if (strcmp(dot + 1, "center") == 0 && value > 0 && value < 255)
+            s.axes[i].center = value;
+        else if (strcmp(dot + 1, "invert") == 0 && (value == 0 || value == 1))
+            s.axes[i].invert = value;
+        else
+            return false;
+        return true;
+    }
+
+    return false;
+}
+
+bool Sticks::setOption(const char *port, const char *key, const char *value)
+{
+    int number;
+    if (!Config::parseInt(value, &number))
+        return false;
+
+    // "[sticks]" applies to every port, and "[sticks N]" only to controller N (1-4)
+    if (!*port)
+    {
+        for (int i = 0; i < MAX_PORTS; i++)
+        {
+            if (!setPortOption(settings[i], key, number))
+                return false;
+        }
+        return true;
+    }
+
+    int index;
+    if (!Config::parseInt(port, &index) || index < 1 || index > MAX_PORTS)
+        return false;
+    return setPortOption(settings[index - 1], key, number);
+}
+
+static void compileAxis(const AxisSettings &s, int32_t *table)
+{
+    // Centre every 256th raw value and scale both sides to full deflection; values in between are interpolated
+    int center = s.center << AXIS_SHIFT;
+    for (int i = 0; i <= 256; i++)
+    {
+        int offset = (i << AXIS_SHIFT) - center;
+        int value = (offset < 0) ? (int64_t)offset * AXIS_FULL / center : (int64_t)offset * (AXIS_FULL - 1) / (0xFFFF - center);
+        table[i] = s.invert ? -value : value;
+    }
+}
+
+static void compileStick(const StickSettings &s, uint16_t *table)
+{
+    int deadzone = s.deadzone * AXIS_FULL / 100;
+    int saturation = s.saturation * AXIS_FULL / 100;
+    if (deadzone >= saturation)
+        deadzone = saturation - 1;
+
+    // Work out the gain for the middle of each magnitude step
+    for (int i = 0; i < 256; i++)
+    {
+        int radius = (i << AXIS_SHIFT) + (1 << (AXIS_SHIFT - 1));
+        int gain;
+
+        if (radius <= deadzone)
+        {
+            gain = 0;
+        }
+        else if (radius >= saturation)
+        {
+            // Past saturation, stay in line with full deflection so diagonals can still reach the corners
+            gain = AXIS_FULL * GAIN_ONE / saturation;
+        }
+        else
+        {
+            // Map the live zone to 0-1 with 12 fractional bits, and bend it towards a cubic by the curve amount
+            int64_t t = (int64_t)(radius - deadzone) * 4096 / (saturation - deadzone);
+            int64_t cubic = ((t * t) >> 12) * t >> 12;
+            int64_t shaped = ((100 - s.curve) * t + s.curve * cubic) / 100;
+
+            // Raise the start of the live zone by the anti-deadzone, to cancel out a game's own deadzone
+            int64_t level = (s.antiDeadzone * 4096 + (100 - s.antiDeadzone) * shaped) / 100;
+            gain = (int)((AXIS_FULL * level >> 12) * GAIN_ONE / radius);
+        }
+
+        table[i] = (gain > 0xFFFF) ? 0xFFFF : gain;
+    }
+}
+
+void Sticks::compile(int port, StickTables &t)
+{
+    // The magnitude table doesn't depend on any settings, so it only has to be built once
+    if (!magnitudes[MAGNITUDE_SIZE - 1][MAGNITUDE_SIZE - 1])
+    {
+        for (int y = 0; y < MAGNITUDE_SIZE; y++)
+        {
+            for (int x = 0; x < MAGNITUDE_SIZE; x++)
+                magnitudes[y][x] = squareRoot(x * x + y * y);
+        }
+    }
+
+    const PortSettings &s = settings[port];
+
+    // Skip shaping entirely for ports that wouldn't change anything
+    t.identity = true;
+    for (int j = 0; j < 2; j++)
+    {
+        if (s.sticks[j].deadzone || s.sticks[j].antiDeadzone || s.sticks[j].saturation != 100 || s.sticks[j].curve)
+            t.identity = false;
+    }
+    for (int j = 0; j < 4; j++)
+    {
+        if (s.axes[j].center != DEFAULT_CENTER || s.axes[j].invert)
+            t.identity = false;
+    }
+
+    for (int j = 0; j < 4; j++)
+        compileAxis(s.axes[j], t.axes[j]);
+    for (int j = 0; j < 2; j++)
+        compileStick(s.sticks[j], t.radial[j]);
+}
+
+static inline int toCentred(const int32_t *table, uint16_t value)
+{
+    // The axis is linear between table entries, so interpolating by the low byte keeps full precision
+    const int32_t *entry = &table[value >> AXIS_SHIFT];
+    return entry[0] + (((entry[1] - entry[0]) * (value & 0xFF)) >> AXIS_SHIFT);
+}
+
+static inline uint16_t toAxis(int value)
+{
+    value += AXIS_FULL;
+    return (value < 0) ? 0 : (value > 0xFFFF) ? 0xFFFF : value;
+}
+
+static inline void shapeStick(const StickTables &t, int stick, uint16_t inX, uint16_t inY, uint16_t &outX, uint16_t &outY)
+{
+    int x = toCentred(t.axes[stick * 2 + 0], inX);
+    int y = toCentred(t.axes[stick * 2 + 1], inY);
+
+    // Look up the gain for the stick's distance from the centre, and scale both axes by it
+    int ax = ((x < 0) ? -x : x) >> AXIS_SHIFT;
+    int ay = ((y < 0) ? -y : y) >> AXIS_SHIFT;
+    if (ax >= MAGNITUDE_SIZE) ax = MAGNITUDE_SIZE - 1;
+    if (ay >= MAGNITUDE_SIZE) ay = MAGNITUDE_SIZE - 1;
+    int gain = t.radial[stick][magnitudes[ay][ax]];
+
+    outX = toAxis((x * gain) >> GAIN_SHIFT);
+    outY = toAxis((y * gain) >> GAIN_SHIFT);
+}
+
+void Sticks::apply(const StickTables &t, const ControlData *in, ControlData *out)
+{
+    *out = *in;
+    if (t.identity)
+        return;
+
+    shapeStick(t, 0, in->leftX, in->leftY, out->leftX, out->leftY);
+    shapeStick(t, 1, in->rightX, in->rightY, out->rightX, out->rightY);
+}
@@ -0,0 +1,28 @@
+#ifndef STICKS_H
+#define STICKS_H
+
+#include <stdint.h>
+
+#include "controller.h"
+
+// Stick response shaping shared by all drivers. Each axis gets a centre and can be inverted, and each stick gets a
+// radial deadzone, anti-deadzone, outer saturation and response curve. Settings come from [sticks] sections in the
+// config file, and are compiled into lookup tables so shaping a report only takes a few table loads per axis.
+struct StickTables
+{
+    bool identity;
+    int32_t axes[4][257];
+    uint16_t radial[2][256];
+};
+
+namespace Sticks
+{
+
+void reset();
+bool setOption(const char *port, const char *key, const char *value);
+void compile(int port, StickTables &t);
+void apply(const StickTables &t, const ControlData *in, ControlData *out);
+
+};
+
+#endif // STICKS_H
@@ -0,0 +1,111 @@
+// Benchmark for the plugin's IMU fusion filter
+//
+// Usage: imubench [updates]
+//
+// Feeds the filter a simulated controller that tilts back and forth at 250 Hz, as a DualShock 4 would report it,
+// and prints the time taken per update along with how far the fused up direction ends up from the true one. On x86
+// the time stamp counter is also read, to give (reference) cycles per update.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "imu_fusion.h"
+
+// DualShock 4 resolutions, sample interval in microseconds, and the tilt motion
+#define ACCEL_PER_G     8192
+#define GYRO_PER_DEGREE 16
+#define SAMPLE_INTERVAL 4000
+#define TILT_RANGE      1.0
+#define TILT_PERIOD     2.0
+
+struct Sample
+{
+    int16_t accel[3];
+    int16_t gyro[3];
+    double up[3];
+};
+
+static int16_t clamp16(double value)
+{
+    value = std::round(value);
+    return (value < -32768) ? -32768 : (value > 32767) ? 32767 : (int16_t)value;
+}
+
+int main(int argc, char **argv)
+{
+    long updates = (argc > 1) ? atol(argv[1]) : 10000000;
+    if (updates <= 0)
+    {
+        fprintf(stderr, "Usage: %s [updates]\n", argv[0]);
+        return 1;
+    }
+
+    // Simulate one period of tilting around the X axis, which turns up in controller space the opposite way
+    const int count = (int)(TILT_PERIOD * 1000000 / SAMPLE_INTERVAL);
+    std::vector<Sample> samples(count);
+    for (int i = 0; i < count; i++)
+    {
+        double t = (double)i * SAMPLE_INTERVAL / 1000000;
+        double angle = TILT_RANGE * std::sin(2 * M_PI * t / TILT_PERIOD);
+        double rate  = TILT_RANGE * 2 * M_PI / TILT_PERIOD * std::cos(2 * M_PI * t / TILT_PERIOD);
+
+        Sample &s = samples[i];
+        s.up[0] = 0;
+        s.up[1] = std::sin(angle);
+        s.up[2] = std::cos(angle);
+        for (int j = 0; j < 3; j++)
+            s.accel[j] = clamp16(s.up[j] * ACCEL_PER_G);
+        s.gyro[0] = clamp16(rate * 180 / M_PI * GYRO_PER_DEGREE);
+        s.gyro[1] = s.gyro[2] = 0;
+    }
+
+    static constexpr ImuDescriptor desc = makeImuDescriptor(ACCEL_PER_G, GYRO_PER_DEGREE, -2, -1);
+    ImuFusion fusion;
+    uint64_t time = 1;
+
+    auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+    uint64_t startTsc = __rdtsc();
+#endif
+
+    for (long i = 0; i < updates; i++)
+    {
+        const Sample &s = samples[i % count];
+        fusion.update(desc, s.accel, s.gyro, time);
+        time += SAMPLE_INTERVAL;
+    }
+
+#ifdef HAVE_TSC
+    uint64_t cycles = __rdtsc() - startTsc;
+#endif
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Compare the fused up direction (the last row of the rotation matrix) with the simulated one
+    ImuState state;
+    if (!fusion.read(&state))
+    {
+        fprintf(stderr, "No state was published\n");
+        return 1;
+    }
+    const Sample &last = samples[(updates - 1) % count];
+    double dot = 0;
+    for (int i = 0; i < 3; i++)
+        dot += state.matrix[2][i] / (double)(1 << UNIT_SHIFT) * last.up[i];
+    double error = std::acos(dot > 1 ? 1 : dot) * 180 / M_PI;
+
+    printf("Updates:      %ld\n", updates);
+    printf("Time:         %.2f ns per update\n", seconds * 1e9 / updates);
+#ifdef HAVE_TSC
+    printf("Cycles:       %.1f per update (TSC)\n", (double)cycles / updates);
+#endif
+    printf("Up error:     %.3f degrees\n", error);
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Benchmark for the plugin's Switch HD rumble encoder
+//
+// Usage: rumblebench [encodes]
+//
+// Encodes a stream of motor values with the table encoder the plugin uses, and with the same curves calculated in
+// floating point with log2f, which is how HD rumble is usually encoded. Prints the time taken per encode for each, and
+// how many of the 256 values per motor they encode differently.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "switch_rumble.h"
+
+static uint8_t floatAmplitude(uint8_t value)
+{
+    // The controller's piecewise log2 curve, as the table encoder follows it
+    if (value == 0)
+        return 0;
+    if (value <= 30)
+        return (uint8_t)std::round(value * 16 / 30.0f);
+
+    float amp = value / 255.0f;
+    float encoded = (value <= 58) ? std::round(std::log2(amp * 17.0f) * 16) : std::round(std::log2(amp * 8.7f) * 32);
+    return (encoded > 100) ? 100 : (uint8_t)encoded;
+}
+
+static uint8_t floatFrequency(float hz)
+{
+    return (uint8_t)std::round(std::log2(hz / 10.0f) * 32);
+}
+
+static void floatEncode(uint8_t small, uint8_t large, uint8_t *data)
+{
+    // Same packing as the table encoder, with both bands calculated on every call
+    uint16_t highFreq = (floatFrequency(SwitchRumble::HIGH_BAND_HZ) - 0x60) * 4;
+    uint8_t lowFreq = floatFrequency(SwitchRumble::LOW_BAND_HZ) - 0x40;
+    uint8_t highAmp = floatAmplitude(small);
+    uint8_t lowAmp = floatAmplitude(large);
+    data[0] = highFreq & 0xFF;
+    data[1] = (highAmp << 1) + (highFreq >> 8);
+    data[2] = lowFreq | ((lowAmp & 1) << 7);
+    data[3] = 0x40 + (lowAmp >> 1);
+}
+
+// Sum of the output, so the encodes can't be optimized away
+static volatile uint32_t checksum;
+
+template <typename Encode> static double timeEncodes(Encode encode, const std::vector<uint8_t> &values, long encodes)
+{
+    uint32_t sum = 0;
+    size_t count = values.size() - 1;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < encodes; i++)
+    {
+        uint8_t data[4];
+        encode(values[i % count], values[i % count + 1], data);
+        sum += data[0] + data[1] + data[2] + data[3];
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    checksum = sum;
+    return seconds * 1e9 / encodes;
+}
+
+int main(int argc, char **argv)
+{
+    long encodes = (argc > 1) ? atol(argv[1]) : 10000000;
+    if (encodes <= 0)
+    {
+        fprintf(stderr, "Usage: %s [encodes]\n", argv[0]);
+        return 1;
+    }
+
+    // Compare every motor value on both bands
+    int highDiffs = 0, lowDiffs = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        uint8_t table[4], reference[4];
+        SwitchRumble::encode(i, i, table);
+        floatEncode(i, i, reference);
+        highDiffs += memcmp(&table[0], &reference[0], 2) != 0;
+        lowDiffs  += memcmp(&table[2], &reference[2], 2) != 0;
+    }
+
+    // Motor values in a random order, as games ramp and change them
+    std::vector<uint8_t> values(4097);
+    srand(1);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = rand() & 0xFF;
+
+    double tableTime = timeEncodes(SwitchRumble::encode, values, encodes);
+    double floatTime = timeEncodes(floatEncode, values, encodes);
+
+    printf("Encodes:      %ld\n", encodes);
+    printf("Tables:       %.2f ns per encode\n", tableTime);
+    printf("Float log2:   %.2f ns per encode\n", floatTime);
+    printf("Differences:  %d high band, %d low band (of 256 values)\n", highDiffs, lowDiffs);
+    return 0;
+}
@@ -0,0 +1,132 @@
+// Layout analyzer for binary raw logs (ux0:data/vitacontrol_raw.bin)
+//
+// Usage: vcanalyze [--slot N] <vitacontrol_raw.bin>
+//
+// Runs every report from one controller slot (the first one in the log by default) through the same streaming
+// analyzer the mapper uses, and prints the inferred buttons, hat, axes and counters.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "analyzer.h"
+#include "vitacontrol_rawlog.h"
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    uint8_t chunk[0x10000];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + count);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int slot = -1;
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "--slot") == 0)
+    {
+        slot = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+
+    if (argc - arg != 1 || slot >= VCRL_MAX_SLOTS)
+    {
+        fprintf(stderr, "Usage: %s [--slot N] <vitacontrol_raw.bin>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    if (!readFile(argv[arg], data))
+    {
+        fprintf(stderr, "Failed to read %s\n", argv[arg]);
+        return 1;
+    }
+
+    if (!vcrlCheckHeader(data.data(), data.size()))
+    {
+        fprintf(stderr, "%s is not a raw log of version %d or older\n", argv[arg], VCRL_VERSION);
+        return 1;
+    }
+
+    static Analyzer analyzer;
+    analyzer_init(&analyzer, nullptr, 0);
+
+    // Feed every report from the chosen slot to the analyzer
+    VcrlSlot slots[VCRL_MAX_SLOTS] = {};
+    uint64_t time = 0;
+    const uint8_t *p = data.data() + VCRL_HEADER_SIZE;
+    const uint8_t *end = data.data() + data.size();
+    uint16_t vid = 0, pid = 0;
+    while (p < end)
+    {
+        int recordSlot, keyframe;
+
+        // Remember which device the analyzed slot belongs to
+        if (vcrlRecordType(p) == VCRL_TYPE_DEVICE)
+        {
+            uint16_t recordVid, recordPid;
+            const uint8_t *next = vcrlDecodeDevice(p, end, &time, &recordSlot, &recordVid, &recordPid);
+            if (!next)
+            {
+                fprintf(stderr, "Stopped at malformed record at offset %zu\n", (size_t)(p - data.data()));
+                break;
+            }
+            p = next;
+            if (slot < 0 || recordSlot == slot)
+            {
+                slot = recordSlot;
+                vid = recordVid;
+                pid = recordPid;
+            }
+            continue;
+        }
+
+        // Lost reports don't change the layout, so they're skipped
+        if (vcrlRecordType(p) == VCRL_TYPE_DROPPED)
+        {
+            uint64_t count;
+            const uint8_t *next = vcrlDecodeDropped(p, end, &time, &count);
+            if (!next)
+            {
+                fprintf(stderr, "Stopped at malformed record at offset %zu\n", (size_t)(p - data.data()));
+                break;
+            }
+            p = next;
+            continue;
+        }
+
+        const uint8_t *next = vcrlDecodeRecord(p, end, slots, &time, &recordSlot, &keyframe);
+        if (!next)
+        {
+            fprintf(stderr, "Stopped at malformed record at offset %zu\n", (size_t)(p - data.data()));
+            break;
+        }
+        p = next;
+
+        if (slot < 0)
+            slot = recordSlot;
+        if (recordSlot == slot)
+            analyzer_ingest(&analyzer, slots[slot].data, (int)slots[slot].length);
+    }
+
+    static AnalyzerResult result;
+    static char text[0x4000];
+    analyzer_infer(&analyzer, &result);
+    analyzer_describe(&analyzer, &result, text, sizeof(text));
+
+    if (vid || pid)
+        printf("Slot %d (VID:PID %04X:%04X)\n%s", slot, vid, pid, text);
+    else
+        printf("Slot %d\n%s", slot < 0 ? 0 : slot, text);
+    return 0;
+}
@@ -0,0 +1,170 @@
+// Decoder for binary raw logs (ux0:data/vitacontrol_raw.bin)
+//
+// Usage: vcdecode [--csv] <vitacontrol_raw.bin> [output]
+//
+// By default, the output uses the same delta line format as vitacontrol_mapper_raw.txt, so existing
+// tooling keeps working. With --csv, every report is written out in full as time_us,slot,length,hex.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "vitacontrol_rawlog.h"
+
+// Bytes of each report included in text lines, as in the plugin's text log (the mapper parses 2-digit indices)
+#define TEXT_REPORT_SIZE 64
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    uint8_t chunk[0x10000];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + count);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static void writeText(FILE *out, const VcrlSlot &slot, const uint8_t *last, bool hasLast)
+{
+    // Match the plugin's text log: the first report of a slot is only used as a baseline, and only the first bytes of
+    // each report are compared, with no line if none of them changed
+    if (!hasLast)
+        return;
+
+    const uint8_t *buf = slot.data;
+    uint32_t length = (slot.length > TEXT_REPORT_SIZE) ? TEXT_REPORT_SIZE : slot.length;
+    if (!memcmp(last, buf, length))
+        return;
+
+    fprintf(out, "id=%02X", buf[0]);
+    if (length >= 8)
+        fprintf(out, " b1=%02X b2=%02X b3=%02X b4=%02X b5=%02X b6=%02X b7=%02X",
+            buf[1], buf[2], buf[3], buf[4], buf[5], buf[6], buf[7]);
+
+    fputs(" ch=[", out);
+    bool first = true;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        if (last[i] == buf[i])
+            continue;
+        fprintf(out, "%s%u:%02X>%02X", first ? "" : ",", i, last[i], buf[i]);
+        first = false;
+    }
+    fputs("]\n", out);
+}
+
+static void writeCsv(FILE *out, uint64_t time, int slot, const VcrlSlot &state)
+{
+    fprintf(out, "%llu,%d,%u,", (unsigned long long)time, slot, state.length);
+    for (uint32_t i = 0; i < state.length; i++)
+        fprintf(out, "%02X", state.data[i]);
+    fputc('\n', out);
+}
+
+int main(int argc, char **argv)
+{
+    bool csv = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--csv") == 0)
+    {
+        csv = true;
+        arg++;
+    }
+
+    if (argc - arg < 1 || argc - arg > 2)
+    {
+        fprintf(stderr, "Usage: %s [--csv] <vitacontrol_raw.bin> [output]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    if (!readFile(argv[arg], data))
+    {
+        fprintf(stderr, "Failed to read %s\n", argv[arg]);
+        return 1;
+    }
+
+    if (!vcrlCheckHeader(data.data(), data.size()))
+    {
+        fprintf(stderr, "%s is not a raw log of version %d or older\n", argv[arg], VCRL_VERSION);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (argc - arg == 2 && !(out = fopen(argv[arg + 1], "w")))
+    {
+        fprintf(stderr, "Failed to open %s\n", argv[arg + 1]);
+        return 1;
+    }
+
+    if (csv)
+        fputs("time_us,slot,length,data\n", out);
+
+    // Decode every record, keeping the previous report of each slot around for text deltas
+    VcrlSlot slots[VCRL_MAX_SLOTS] = {};
+    uint8_t last[VCRL_MAX_SLOTS][VCRL_MAX_REPORT] = {};
+    bool hasLast[VCRL_MAX_SLOTS] = {};
+    uint64_t time = 0;
+    uint64_t dropped = 0;
+    size_t records = 0;
+
+    const uint8_t *p = data.data() + VCRL_HEADER_SIZE;
+    const uint8_t *end = data.data() + data.size();
+    while (p < end)
+    {
+        int slot, keyframe;
+
+        // Device records become the same comment lines the plugin writes in text logs
+        if (vcrlRecordType(p) == VCRL_TYPE_DEVICE)
+        {
+            uint16_t vid, pid;
+            if (!(p = vcrlDecodeDevice(p, end, &time, &slot, &vid, &pid)))
+                break;
+            if (!csv)
+                fprintf(out, "# device slot=%d vid=%04X pid=%04X\n", slot, vid, pid);
+            continue;
+        }
+
+        // Dropped records become the plugin's running total, as in text logs
+        if (vcrlRecordType(p) == VCRL_TYPE_DROPPED)
+        {
+            uint64_t count;
+            if (!(p = vcrlDecodeDropped(p, end, &time, &count)))
+                break;
+            dropped += count;
+            if (!csv)
+                fprintf(out, "# dropped=%llu\n", (unsigned long long)dropped);
+            continue;
+        }
+
+        const uint8_t *next = vcrlDecodeRecord(p, end, slots, &time, &slot, &keyframe);
+        if (!next)
+        {
+            // A truncated final record is expected if the log was cut short, so just stop there
+            fprintf(stderr, "Stopped at malformed record at offset %zu\n", (size_t)(p - data.data()));
+            break;
+        }
+        p = next;
+        records++;
+
+        if (csv)
+            writeCsv(out, time, slot, slots[slot]);
+        else
+            writeText(out, slots[slot], last[slot], hasLast[slot]);
+
+        memcpy(last[slot], slots[slot].data, VCRL_MAX_REPORT);
+        hasLast[slot] = true;
+    }
+
+    if (out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "Decoded %zu records, %llu dropped by the plugin\n", records, (unsigned long long)dropped);
+    return 0;
+}
@@ -0,0 +1,520 @@
+// Bulk scanner for raw log corpora (vitacontrol_mapper_raw.txt and vitacontrol_raw.bin files)
+//
+// Usage: vcscan [-j threads] <log>...
+//
+// Memory-maps every log and scans them on several threads, then prints one summary per controller VID:PID: bit
+// activity for each report byte, report interval statistics (binary logs only, since text lines aren't timed) and
+// anomaly counts. Reports are attributed to devices through the device records/lines the plugin writes; reports
+// from older logs without them are counted under 0000:0000.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "vitacontrol_rawlog.h"
+
+// Report intervals are binned in 50us steps up to 100ms; longer ones count as gaps
+#define INTERVAL_STEP 50
+#define INTERVAL_BINS 2000
+#define GAP_INTERVAL  (INTERVAL_STEP * INTERVAL_BINS)
+
+struct Group
+{
+    uint64_t files = 0;
+    uint64_t reports = 0;
+    uint64_t textReports = 0;
+
+    // How often each bit of each report byte changed
+    uint64_t toggles[VCRL_MAX_REPORT][8] = {};
+
+    // Intervals between reports from the same slot
+    uint64_t intervals[INTERVAL_BINS] = {};
+    uint64_t intervalCount = 0;
+    uint64_t intervalSum = 0;
+    uint64_t intervalMax = 0;
+
+    // Anomalies
+    uint64_t malformed = 0;
+    uint64_t dropped = 0;
+    uint64_t gaps = 0;
+    uint64_t lengthChanges = 0;
+
+    // The last file that added to this group on the scanning thread, for counting files
+    uint64_t lastFile = 0;
+
+    void addFile(uint64_t file);
+    void merge(const Group &other);
+};
+
+typedef std::map<uint32_t, Group> Groups;
+
+// Totals for the summary line
+struct Totals
+{
+    uint64_t bytes = 0;
+    uint64_t failed = 0;
+};
+
+// Hex digit values, with 0xFF for anything else
+static uint8_t hexTable[256];
+
+void Group::addFile(uint64_t file)
+{
+    if (file != lastFile)
+    {
+        files++;
+        lastFile = file;
+    }
+}
+
+void Group::merge(const Group &other)
+{
+    files += other.files;
+    reports += other.reports;
+    textReports += other.textReports;
+    for (int i = 0; i < VCRL_MAX_REPORT; i++)
+        for (int j = 0; j < 8; j++)
+            toggles[i][j] += other.toggles[i][j];
+    for (int i = 0; i < INTERVAL_BINS; i++)
+        intervals[i] += other.intervals[i];
+    intervalCount += other.intervalCount;
+    intervalSum += other.intervalSum;
+    if (other.intervalMax > intervalMax)
+        intervalMax = other.intervalMax;
+    malformed += other.malformed;
+    dropped += other.dropped;
+    gaps += other.gaps;
+    lengthChanges += other.lengthChanges;
+}
+
+static void initHexTable()
+{
+    memset(hexTable, 0xFF, sizeof(hexTable));
+    for (int i = 0; i < 10; i++)
+        hexTable['0' + i] = i;
+    for (int i = 0; i < 6; i++)
+        hexTable['A' + i] = hexTable['a' + i] = 10 + i;
+}
+
+static inline void addToggles(Group &group, uint32_t index, uint8_t changed)
+{
+    while (changed)
+    {
+        int bit = __builtin_ctz(changed);
+        group.toggles[index][bit]++;
+        changed &= changed - 1;
+    }
+}
+
+static inline void addInterval(Group &group, uint64_t interval)
+{
+    group.intervalCount++;
+    group.intervalSum += interval;
+    if (interval > group.intervalMax)
+        group.intervalMax = interval;
+    if (interval >= GAP_INTERVAL)
+        group.gaps++;
+    else
+        group.intervals[interval / INTERVAL_STEP]++;
+}
+
+// Parse 2 hex digits, returning a value above 0xFF if either isn't valid
+static inline uint32_t parseHex2(const char *p)
+{
+    uint8_t hi = hexTable[(uint8_t)p[0]];
+    uint8_t lo = hexTable[(uint8_t)p[1]];
+    return ((hi | lo) > 0xF) ? 0x100 : (hi << 4) | lo;
+}
+
+static inline uint32_t parseHex4(const char *p)
+{
+    uint32_t hi = parseHex2(p), lo = parseHex2(p + 2);
+    return ((hi | lo) > 0xFF) ? 0x10000 : (hi << 8) | lo;
+}
+
+static bool startsWith(const char *p, const char *end, const char *prefix)
+{
+    size_t length = strlen(prefix);
+    return (size_t)(end - p) >= length && memcmp(p, prefix, length) == 0;
+}
+
+static void scanBinary(const uint8_t *data, size_t size, uint64_t file, Groups &groups)
+{
+    VcrlSlot slots[VCRL_MAX_SLOTS] = {};
+    uint8_t last[VCRL_MAX_SLOTS][VCRL_MAX_REPORT];
+    uint32_t lastLength[VCRL_MAX_SLOTS] = {};
+    uint64_t lastTime[VCRL_MAX_SLOTS] = {};
+    bool hasLast[VCRL_MAX_SLOTS] = {};
+    Group *slotGroups[VCRL_MAX_SLOTS];
+    int lastSlot = 0;
+    uint64_t time = 0;
+
+    for (int i = 0; i < VCRL_MAX_SLOTS; i++)
+        slotGroups[i] = &groups[0];
+
+    const uint8_t *p = data + VCRL_HEADER_SIZE;
+    const uint8_t *end = data + size;
+    while (p < end)
+    {
+        int slot, keyframe;
+
+        if (vcrlRecordType(p) == VCRL_TYPE_DEVICE)
+        {
+            uint16_t vid, pid;
+            if (!(p = vcrlDecodeDevice(p, end, &time, &slot, &vid, &pid)))
+                break;
+
+            // A new device starts over without a previous report
+            slotGroups[slot] = &groups[(vid << 16) | pid];
+            hasLast[slot] = false;
+            continue;
+        }
+
+        // Reports lost by the plugin are counted for the device that reported last, as in text logs
+        if (vcrlRecordType(p) == VCRL_TYPE_DROPPED)
+        {
+            uint64_t count;
+            if (!(p = vcrlDecodeDropped(p, end, &time, &count)))
+                break;
+            if (count)
+            {
+                slotGroups[lastSlot]->addFile(file);
+                slotGroups[lastSlot]->dropped += count;
+            }
+            continue;
+        }
+
+        const uint8_t *next = vcrlDecodeRecord(p, end, slots, &time, &slot, &keyframe);
+        if (!next)
+        {
+            // A truncated final record just means the log was cut short
+            if (end - p > VCRL_MAX_RECORD)
+            {
+                slotGroups[0]->addFile(file);
+                slotGroups[0]->malformed++;
+            }
+            break;
+        }
+        p = next;
+
+        Group &group = *slotGroups[slot];
+        const VcrlSlot &state = slots[slot];
+        lastSlot = slot;
+        group.addFile(file);
+        group.reports++;
+
+        if (hasLast[slot])
+        {
+            addInterval(group, time - lastTime[slot]);
+            if (state.length != lastLength[slot])
+                group.lengthChanges++;
+            uint32_t length = (state.length < lastLength[slot]) ? state.length : lastLength[slot];
+            for (uint32_t i = 0; i < length; i++)
+                if (uint8_t changed = state.data[i] ^ last[slot][i])
+                    addToggles(group, i, changed);
+        }
+
+        memcpy(last[slot], state.data, state.length);
+        lastLength[slot] = state.length;
+        lastTime[slot] = time;
+        hasLast[slot] = true;
+    }
+}
+
+// Parse one "id=.. b1=.. ... ch=[idx:old>new,...]" line, returning false if it's malformed
+static bool scanTextLine(const char *p, const char *end, Group &group)
+{
+    // Skip ahead to the changed bytes; memchr is much faster than checking the fixed fields one by one
+    const char *ch = (const char *)memchr(p, '[', end - p);
+    if (!ch || ch - p < 4 || memcmp(ch - 3, "ch=", 3) != 0 || end[-1] != ']')
+        return false;
+
+    // Each entry is a 1-3 digit decimal index, then ":OO>NN"
+    p = ch + 1;
+    end--;
+    while (p < end)
+    {
+        uint32_t index = 0;
+        int digits = 0;
+        while (p < end && *p >= '0' && *p <= '9' && digits < 3)
+        {
+            index = index * 10 + (*p++ - '0');
+            digits++;
+        }
+        if (!digits || index >= VCRL_MAX_REPORT || end - p < 6 || p[0] != ':' || p[3] != '>')
+            return false;
+
+        uint32_t oldValue = parseHex2(p + 1), newValue = parseHex2(p + 4);
+        if ((oldValue | newValue) > 0xFF)
+            return false;
+        addToggles(group, index, oldValue ^ newValue);
+        p += 6;
+
+        if (p < end && *p++ != ',')
+            return false;
+    }
+
+    group.reports++;
+    group.textReports++;
+    return true;
+}
+
+static void scanText(const char *data, size_t size, uint64_t file, Groups &groups)
+{
+    Group *group = &groups[0];
+    uint32_t lastDropped = 0;
+
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end)
+    {
+        const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+        const char *next = lineEnd ? lineEnd + 1 : end;
+        if (!lineEnd)
+            lineEnd = end;
+        if (lineEnd > p && lineEnd[-1] == '\r')
+            lineEnd--;
+
+        if (startsWith(p, lineEnd, "id="))
+        {
+            group->addFile(file);
+            if (!scanTextLine(p, lineEnd, *group))
+                group->malformed++;
+        }
+        else if (startsWith(p, lineEnd, "# device slot="))
+        {
+            // "# device slot=N vid=XXXX pid=XXXX"
+            const char *vid = p + 14;
+            while (vid < lineEnd && *vid != ' ') vid++;
+            uint32_t vidValue = 0x10000, pidValue = 0x10000;
+            if (lineEnd - vid == 18 && memcmp(vid, " vid=", 5) == 0 && memcmp(vid + 9, " pid=", 5) == 0)
+            {
+                vidValue = parseHex4(vid + 5);
+                pidValue = parseHex4(vid + 14);
+            }
+
+            if ((vidValue | pidValue) > 0xFFFF)
+            {
+                group->addFile(file);
+                group->malformed++;
+            }
+            else
+            {
+                group = &groups[(vidValue << 16) | pidValue];
+            }
+        }
+        else if (startsWith(p, lineEnd, "# dropped="))
+        {
+            // The plugin logs the total dropped so far
+            uint32_t count = strtoul(p + 10, nullptr, 10);
+            if (count > lastDropped)
+            {
+                group->addFile(file);
+                group->dropped += count - lastDropped;
+            }
+            lastDropped = count;
+        }
+        else if (lineEnd > p && *p != '#')
+        {
+            group->addFile(file);
+            group->malformed++;
+        }
+
+        p = next;
+    }
+}
+
+static bool scanFile(const char *path, uint64_t file, Groups &groups, Totals &totals)
+{
+    std::vector<uint8_t> buffer;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+#ifndef _WIN32
+    // Map the file so it's read straight from the page cache without copies
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    size = info.st_size;
+    void *mapping = nullptr;
+    if (size > 0)
+    {
+        mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = (const uint8_t*)mapping;
+    }
+    close(fd);
+#else
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    uint8_t chunk[0x10000];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + count);
+    fclose(file);
+    data = buffer.data();
+    size = buffer.size();
+#endif
+
+    // Binary logs are recognised by their header, and anything else is treated as text
+    if (vcrlCheckHeader(data, size))
+        scanBinary(data, size, file, groups);
+    else
+        scanText((const char*)data, size, file, groups);
+    totals.bytes += size;
+
+#ifndef _WIN32
+    if (mapping)
+        munmap(mapping, size);
+#endif
+    return true;
+}
+
+static uint64_t percentile(const Group &group, double fraction)
+{
+    // Find the bin containing the percentile, counting gaps as the longest intervals
+    uint64_t target = (uint64_t)(fraction * (group.intervalCount - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < INTERVAL_BINS; i++)
+    {
+        seen += group.intervals[i];
+        if (seen >= target)
+            return i * INTERVAL_STEP + INTERVAL_STEP / 2;
+    }
+    return GAP_INTERVAL;
+}
+
+static void printGroup(uint32_t id, const Group &group)
+{
+    printf("VID:PID %04X:%04X  files %llu  reports %llu (%llu from text logs)\n", id >> 16, id & 0xFFFF,
+        (unsigned long long)group.files, (unsigned long long)group.reports, (unsigned long long)group.textReports);
+
+    if (group.intervalCount > 0)
+    {
+        double mean = (double)group.intervalSum / group.intervalCount;
+        printf("  interval us: mean %.1f (%.1f Hz)  p50 %llu  p95 %llu  p99 %llu  max %llu\n", mean, 1000000.0 / mean,
+            (unsigned long long)percentile(group, 0.50), (unsigned long long)percentile(group, 0.95),
+            (unsigned long long)percentile(group, 0.99), (unsigned long long)group.intervalMax);
+    }
+    else
+    {
+        printf("  interval us: n/a (no timed reports)\n");
+    }
+
+    printf("  anomalies: malformed %llu  dropped %llu  gaps over %dms %llu  length changes %llu\n",
+        (unsigned long long)group.malformed, (unsigned long long)group.dropped, GAP_INTERVAL / 1000,
+        (unsigned long long)group.gaps, (unsigned long long)group.lengthChanges);
+
+    // Only list bytes that changed at all, with toggle counts from bit 7 down to bit 0
+    printf("  bit activity (byte: mask, toggles for bits 7..0):\n");
+    for (int i = 0; i < VCRL_MAX_REPORT; i++)
+    {
+        uint8_t mask = 0;
+        for (int j = 0; j < 8; j++)
+            if (group.toggles[i][j]) mask |= 1 << j;
+        if (!mask)
+            continue;
+
+        printf("    %3d: %02X ", i, mask);
+        for (int j = 7; j >= 0; j--)
+            printf(" %llu", (unsigned long long)group.toggles[i][j]);
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int threadCount = std::thread::hardware_concurrency();
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "-j") == 0)
+    {
+        threadCount = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+
+    if (argc - arg < 1 || threadCount < 0)
+    {
+        fprintf(stderr, "Usage: %s [-j threads] <log>...\n", argv[0]);
+        return 1;
+    }
+
+    initHexTable();
+
+    int fileCount = argc - arg;
+    if (threadCount < 1)
+        threadCount = 1;
+    if (threadCount > fileCount)
+        threadCount = fileCount;
+
+    // Each thread takes the next unscanned file and keeps its own results, so nothing is shared until the merge
+    std::atomic<int> nextFile(0);
+    std::vector<Groups> threadGroups(threadCount);
+    std::vector<Totals> threadTotals(threadCount);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            int index;
+            while ((index = nextFile++) < fileCount)
+            {
+                if (!scanFile(argv[arg + index], index + 1, threadGroups[t], threadTotals[t]))
+                {
+                    fprintf(stderr, "Failed to read %s\n", argv[arg + index]);
+                    threadTotals[t].failed++;
+                }
+            }
+        });
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // Merge the results of every thread
+    static Groups groups;
+    Totals totals;
+    for (int t = 0; t < threadCount; t++)
+    {
+        for (const auto &entry : threadGroups[t])
+            groups[entry.first].merge(entry.second);
+        totals.bytes += threadTotals[t].bytes;
+        totals.failed += threadTotals[t].failed;
+    }
+
+    for (const auto &entry : groups)
+    {
+        if (entry.second.reports || entry.second.malformed || entry.second.dropped)
+            printGroup(entry.first, entry.second);
+    }
+
+    fprintf(stderr, "Scanned %d files (%llu bytes) on %d threads, %llu failed\n", fileCount - (int)totals.failed,
+        (unsigned long long)totals.bytes, threadCount, (unsigned long long)totals.failed);
+    return totals.failed ? 1 : 0;
+}
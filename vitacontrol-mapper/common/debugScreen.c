@@ -62,6 +62,14 @@
 *    Similar to the C library function printf() formats a string and ouputs
 *    it via psvDebugScreenPuts() to the debug screen.
 *
+* - psvDebugScreenBeginFrame()
+*    Starts redrawing the whole screen, like clearing it and moving the cursor home, but without touching any pixels.
+*    Text cells that are printed again unchanged are skipped, and psvDebugScreenEndFrame() clears the ones that
+*    weren't printed again. Useful for screens that are refreshed often, like live dashboards.
+*
+* - psvDebugScreenEndFrame()
+*    Clears the text cells that weren't printed since psvDebugScreenBeginFrame().
+*
 * - psvDebugScreenGetColorStateCopy(ColorState *copy)
 *    Get copy of current color state.
 *
@@ -128,6 +136,25 @@ static ColorState colors = {
 
 static PsvDebugScreenFont *psvDebugScreenFontCurrent = &psvDebugScreenFont;
 
+// Glyphs pre-expanded to 32-bit pixels for the current font and colors, built on first use of each glyph
+static PsvDebugScreenFont *glyphCacheFont = NULL;
+static uint32_t glyphCacheFg, glyphCacheBg;
+static uint32_t *glyphCache = NULL;
+static unsigned char glyphCacheValid[256];
+
+// What each text cell on screen currently shows, so unchanged cells can be skipped
+// Cells are sized for the current font; the grid is big enough for the smallest (8x8) cell size
+#define SHADOW_COLS    ((SCREEN_WIDTH) / 8)
+#define SHADOW_ROWS    ((SCREEN_HEIGHT) / 8)
+#define SHADOW_UNKNOWN (0x100) // cell content isn't known, so it always gets drawn
+typedef struct ShadowCell {
+	uint32_t fg, bg;
+	uint16_t ch;
+	uint8_t stale; // not printed since psvDebugScreenBeginFrame()
+} ShadowCell;
+static ShadowCell shadow[SHADOW_ROWS * SHADOW_COLS];
+static int shadowCellW = 0, shadowCellH = 0;
+
 #ifdef __vita__
 #include <psp2/display.h>
 #include <psp2/kernel/sysmem.h>
@@ -263,6 +290,143 @@ static void psvDebugScreenSetColors(void) {
 	*color_bg |= 0xFF000000; // opaque
 }
 
+/*
+* Make sure the shadow grid matches the current cell size, forgetting its contents if it changed
+*/
+static int psvDebugScreenShadowCheck(void) {
+	if ((shadowCellW != (F)->size_w) || (shadowCellH != (F)->size_h)) {
+		shadowCellW = (F)->size_w;
+		shadowCellH = (F)->size_h;
+		for (int i = 0; i < SHADOW_ROWS * SHADOW_COLS; i++) {
+			shadow[i].ch = SHADOW_UNKNOWN;
+			shadow[i].stale = 0;
+		}
+	}
+	// only grids that evenly cover the screen are tracked
+	return (shadowCellW >= 8) && (shadowCellH >= 8) && !((SCREEN_WIDTH) % shadowCellW) && !((SCREEN_HEIGHT) % shadowCellH);
+}
+
+/*
+* Update the shadow cells covered by a pixel rectangle: cells fully inside it become blank, partially covered ones unknown
+*/
+static void psvDebugScreenShadowRect(int x0, int y0, int x1, int y1, int blank) {
+	if (!psvDebugScreenShadowCheck()) return;
+	int cols = (SCREEN_WIDTH) / shadowCellW, rows = (SCREEN_HEIGHT) / shadowCellH;
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	for (int row = y0 / shadowCellH; (row < rows) && (row * shadowCellH < y1); row++) {
+		for (int col = x0 / shadowCellW; (col < cols) && (col * shadowCellW < x1); col++) {
+			ShadowCell *cell = &shadow[row * SHADOW_COLS + col];
+			int inside = (col * shadowCellW >= x0) && ((col + 1) * shadowCellW <= x1) &&
+				(row * shadowCellH >= y0) && ((row + 1) * shadowCellH <= y1);
+			cell->ch = (inside && blank) ? ' ' : SHADOW_UNKNOWN;
+			cell->fg = 0;
+			cell->bg = colors.color_bg;
+			cell->stale = 0;
+		}
+	}
+}
+
+/*
+* Fill one text cell with the background color and mark it blank
+*/
+static void psvDebugScreenShadowClearCell(int col, int row) {
+	ShadowCell *cell = &shadow[row * SHADOW_COLS + col];
+	uint32_t *vram = (uint32_t *)base + (col * shadowCellW) + (row * shadowCellH * (SCREEN_FB_WIDTH));
+	for (int h = 0; h < shadowCellH; h++, vram += (SCREEN_FB_WIDTH))
+		for (int w = 0; w < shadowCellW; w++)
+			vram[w] = colors.color_bg;
+	cell->ch = ' ';
+	cell->fg = 0;
+	cell->bg = colors.color_bg;
+	cell->stale = 0;
+}
+
+/*
+* Expand a glyph of the current font to 32-bit pixels in the current colors, including its margins
+*/
+static uint32_t *psvDebugScreenCachedGlyph(unsigned char t) {
+	int cell_pixels = (F)->size_w * (F)->size_h;
+
+	// start over when the font or colors change
+	if ((glyphCacheFont != F) || (glyphCacheFg != colors.color_fg) || (glyphCacheBg != colors.color_bg)) {
+		if (glyphCacheFont != F) {
+			free(glyphCache);
+			glyphCache = (uint32_t *)malloc(sizeof(uint32_t) * cell_pixels * ((F)->last - (F)->first + 1));
+			if (!glyphCache) {
+				glyphCacheFont = NULL;
+				return NULL;
+			}
+		}
+		glyphCacheFont = F;
+		glyphCacheFg = colors.color_fg;
+		glyphCacheBg = colors.color_bg;
+		memset(glyphCacheValid, 0, sizeof(glyphCacheValid));
+	}
+
+	uint32_t *glyph = glyphCache + (t - (F)->first) * cell_pixels;
+	if (glyphCacheValid[t]) return glyph;
+
+	// works also with not byte-aligned glyphs
+	int bitmap_offset = (t - (F)->first) * (F)->width * (F)->height;
+	unsigned char *font = &(F)->glyphs[bitmap_offset / 8];
+	unsigned char mask = (1 << 7) >> (bitmap_offset % 8);
+	uint32_t *pixel = glyph;
+	for (int row = 0; row < (F)->size_h; row++) {
+		for (int col = 0; col < (F)->size_w; col++) {
+			if ((row >= (F)->height) || (col >= (F)->width)) { // margins
+				*pixel++ = colors.color_bg;
+				continue;
+			}
+			if (!mask) { font++; mask = 1 << 7; } // no more bits: we exhausted this byte
+			*pixel++ = (*font & mask) ? colors.color_fg : colors.color_bg;
+			mask >>= 1;
+		}
+	}
+	glyphCacheValid[t] = 1;
+	return glyph;
+}
+
+/*
+* Draw a glyph at the cursor, skipping it if the text cell already shows it
+*/
+static int psvDebugScreenDrawCachedGlyph(unsigned char t) {
+	int tracked = psvDebugScreenShadowCheck();
+	ShadowCell *cell = NULL;
+	uint16_t ch = t;
+	uint32_t fg = colors.color_fg;
+
+	// spaces look the same in any foreground color
+	if (t == ' ') fg = 0;
+
+	if (tracked && !(coordX % shadowCellW) && !(coordY % shadowCellH)) {
+		cell = &shadow[(coordY / shadowCellH) * SHADOW_COLS + (coordX / shadowCellW)];
+		if ((cell->ch == ch) && (cell->fg == fg) && (cell->bg == colors.color_bg)) {
+			cell->stale = 0;
+			return 1;
+		}
+	}
+
+	uint32_t *glyph = psvDebugScreenCachedGlyph(t);
+	if (!glyph) return 0;
+
+	// copy whole rows of pre-expanded pixels
+	uint32_t *vram = ((uint32_t*)base) + coordX + (coordY * (SCREEN_FB_WIDTH));
+	size_t row_bytes = sizeof(uint32_t) * (F)->size_w;
+	for (int row = 0; row < (F)->size_h; row++, vram += (SCREEN_FB_WIDTH), glyph += (F)->size_w)
+		memcpy(vram, glyph, row_bytes);
+
+	if (cell) {
+		cell->ch = ch;
+		cell->fg = fg;
+		cell->bg = colors.color_bg;
+		cell->stale = 0;
+	} else if (tracked) {
+		psvDebugScreenShadowRect(coordX, coordY, coordX + (F)->size_w, coordY + (F)->size_h, 0);
+	}
+	return 1;
+}
+
 /*
 * Parse CSI sequences
 */
@@ -318,13 +482,35 @@ static size_t psvDebugScreenEscape(const unsigned char *str) {
 			case 'K':
 				if (arg[0]==0) { // from cursor to end of line/screen
 					CLEARSCRNBLOCK(coordY, coordY + (F)->size_h, coordX, (SCREEN_WIDTH), colors.color_bg); // line
-					if (str[i]=='J') CLEARSCRNLINES(coordY + (F)->size_h, (SCREEN_HEIGHT), colors.color_bg); // screen
+					psvDebugScreenShadowRect(coordX, coordY, (SCREEN_WIDTH), coordY + (F)->size_h, 1);
+					if (str[i]=='J') {
+						CLEARSCRNLINES(coordY + (F)->size_h, (SCREEN_HEIGHT), colors.color_bg); // screen
+						psvDebugScreenShadowRect(0, coordY + (F)->size_h, (SCREEN_WIDTH), (SCREEN_HEIGHT), 1);
+					}
 				} else if (arg[0]==1) { // from beginning of line/screen to cursor
 					CLEARSCRNBLOCK(coordY, coordY + (F)->size_h, 0, coordX, colors.color_bg); // line
-					if (str[i]=='J') CLEARSCRNLINES(0, coordY, colors.color_bg); // screen
+					psvDebugScreenShadowRect(0, coordY, coordX, coordY + (F)->size_h, 1);
+					if (str[i]=='J') {
+						CLEARSCRNLINES(0, coordY, colors.color_bg); // screen
+						psvDebugScreenShadowRect(0, 0, (SCREEN_WIDTH), coordY, 1);
+					}
 				} else if (arg[0]==2) { // whole line/screen
-					if (str[i]=='K') CLEARSCRNLINES(coordY, coordY + (F)->size_h, colors.color_bg) // line
-					else if (str[i]=='J') CLEARSCRNLINES(0, (SCREEN_HEIGHT), colors.color_bg); // screen
+					if (str[i]=='K') {
+						CLEARSCRNLINES(coordY, coordY + (F)->size_h, colors.color_bg) // line
+						psvDebugScreenShadowRect(0, coordY, (SCREEN_WIDTH), coordY + (F)->size_h, 1);
+					} else if (str[i]=='J') {
+						if (psvDebugScreenShadowCheck()) { // screen, skipping cells that are already blank
+							for (int row = 0; row < (SCREEN_HEIGHT) / shadowCellH; row++)
+								for (int col = 0; col < (SCREEN_WIDTH) / shadowCellW; col++) {
+									ShadowCell *cell = &shadow[row * SHADOW_COLS + col];
+									if ((cell->ch != ' ') || (cell->bg != colors.color_bg))
+										psvDebugScreenShadowClearCell(col, row);
+									cell->stale = 0;
+								}
+						} else {
+							CLEARSCRNLINES(0, (SCREEN_HEIGHT), colors.color_bg); // screen
+						}
+					}
 				}
 				return i;
 			// color
@@ -507,8 +693,15 @@ int psvDebugScreenPuts(const char * _text) {
 			continue;
 		}
 
+		// draw cached glyph, unless it's not available in font
+		if ((t <= (F)->last) && (t >= (F)->first) && psvDebugScreenDrawCachedGlyph(t)) {
+			coordX += (F)->size_w;
+			continue;
+		}
+
 		// draw glyph or dummy glyph (dotted line in the middle)
 		// works also with not byte-aligned glyphs
+		psvDebugScreenShadowRect(coordX, coordY, coordX + (F)->size_w, coordY + (F)->size_h, 0);
 		vram = ((uint32_t*)base) + coordX + (coordY * (SCREEN_FB_WIDTH));
 		row = 0;
 		// check if glyph is available in font
@@ -571,6 +764,39 @@ int psvDebugScreenPuts(const char * _text) {
 }
 
 
+/*
+* Start redrawing the screen without clearing it
+*/
+void psvDebugScreenBeginFrame(void) {
+	sceKernelLockMutex(mutex, 1, NULL);
+	if (psvDebugScreenShadowCheck()) {
+		for (int i = 0; i < SHADOW_ROWS * SHADOW_COLS; i++)
+			shadow[i].stale = 1;
+	} else {
+		CLEARSCRNLINES(0, (SCREEN_HEIGHT), colors.color_bg);
+	}
+	coordX = coordY = 0;
+	sceKernelUnlockMutex(mutex, 1);
+}
+
+/*
+* Clear whatever wasn't printed again since psvDebugScreenBeginFrame()
+*/
+void psvDebugScreenEndFrame(void) {
+	sceKernelLockMutex(mutex, 1, NULL);
+	if (psvDebugScreenShadowCheck()) {
+		for (int row = 0; row < (SCREEN_HEIGHT) / shadowCellH; row++)
+			for (int col = 0; col < (SCREEN_WIDTH) / shadowCellW; col++) {
+				ShadowCell *cell = &shadow[row * SHADOW_COLS + col];
+				if (!cell->stale) continue;
+				if ((cell->ch != ' ') || (cell->bg != colors.color_bg))
+					psvDebugScreenShadowClearCell(col, row);
+				cell->stale = 0;
+			}
+	}
+	sceKernelUnlockMutex(mutex, 1);
+}
+
 /*
 * Printf text onto debug screen
 */
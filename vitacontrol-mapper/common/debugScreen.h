@@ -45,6 +45,8 @@ int psvDebugScreenInit();
 int psvDebugScreenFinish();
 int psvDebugScreenPuts(const char * _text);
 int psvDebugScreenPrintf(const char *format, ...);
+void psvDebugScreenBeginFrame(void);
+void psvDebugScreenEndFrame(void);
 void psvDebugScreenGetColorStateCopy(ColorState *copy);
 void psvDebugScreenGetCoordsXY(int *x, int *y);
 void psvDebugScreenSetCoordsXY(int *x, int *y);
@@ -0,0 +1,407 @@
+#include "analyzer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Share of transitions a byte must change in, and step by the same amount in, to count as a counter
+#define COUNTER_CHANGE_PCT 75
+#define COUNTER_REPEAT_PCT 50
+
+// Wrap-arounds with a carry into the neighbouring byte needed to treat two bytes as one 16-bit axis
+#define AXIS16_MIN_CARRIES 2
+
+// Without carries, a byte that changes at least this many times as often as its neighbour, and almost every time
+// the neighbour does, is taken as the low byte of a 16-bit axis (jittery low bits under a steadier high byte)
+#define AXIS16_CHANGE_RATIO  2
+#define AXIS16_TOGETHER_PCT  90
+#define AXIS16_MIN_DISTINCT  32
+
+// Distinct values and toggled bits needed to treat a byte as an 8-bit axis rather than buttons
+#define AXIS8_MIN_DISTINCT 16
+#define AXIS8_MIN_BITS     6
+
+// Smallest deviation from centre that counts as deliberate axis movement during a prompt
+#define AXIS_MIN_DEVIATION 0x20
+
+static const char *const HAT_NAMES[ANALYZER_HAT_COUNT] = {"up", "right", "down", "left"};
+static const char *const AXIS_NAMES[ANALYZER_AXIS_COUNT] = {"LX", "LY", "RX", "RY"};
+
+static int bit_count(uint32_t v) {
+  int n = 0;
+  for (; v; v &= v - 1) n++;
+  return n;
+}
+
+static int distinct_values(const AnalyzerByteStats *st) {
+  int n = 0;
+  for (int i = 0; i < 8; i++) n += bit_count(st->seen[i]);
+  return n;
+}
+
+static int toggled_bits(const AnalyzerByteStats *st) {
+  int n = 0;
+  for (int b = 0; b < 8; b++) n += st->toggles[b] != 0;
+  return n;
+}
+
+static uint8_t toggled_mask(const AnalyzerByteStats *st) {
+  uint8_t mask = 0;
+  for (int b = 0; b < 8; b++) if (st->toggles[b]) mask |= 1 << b;
+  return mask;
+}
+
+static void mark_seen(AnalyzerByteStats *st, uint8_t v) {
+  st->seen[v >> 5] |= 1u << (v & 31);
+}
+
+// Direction a byte wrapped around in when going from old to v by the shortest step: 1 up, -1 down, 0 none
+static int wrap_direction(uint8_t old, uint8_t v) {
+  uint8_t up = (uint8_t)(v - old);
+  if (v < old && up < 0x80) return 1;
+  if (v > old && (uint8_t)(old - v) < 0x80) return -1;
+  return 0;
+}
+
+void analyzer_init(Analyzer *a, const AnalyzerPrompt *prompts, int prompt_count) {
+  memset(a, 0, sizeof(*a));
+  a->prompt = ANALYZER_NO_PROMPT;
+  a->prompts = prompts;
+  a->prompt_count = prompt_count > ANALYZER_MAX_PROMPTS ? ANALYZER_MAX_PROMPTS : prompt_count;
+}
+
+void analyzer_set_prompt(Analyzer *a, int prompt) {
+  a->prompt = (prompt >= 0 && prompt < a->prompt_count) ? prompt : ANALYZER_NO_PROMPT;
+}
+
+void analyzer_ingest(Analyzer *a, const uint8_t *data, int length) {
+  if (length <= 0) return;
+  if (length > ANALYZER_MAX_REPORT) length = ANALYZER_MAX_REPORT;
+
+  // The first report is taken as the resting state everything else is compared to
+  if (a->reports == 0) {
+    a->length = length;
+    for (int i = 0; i < ANALYZER_MAX_REPORT; i++) {
+      uint8_t v = i < length ? data[i] : 0;
+      a->rest[i] = a->last[i] = v;
+      a->bytes[i].min = a->bytes[i].max = v;
+      mark_seen(&a->bytes[i], v);
+    }
+  }
+  else if (length > a->length) {
+    a->length = length;
+  }
+  a->reports++;
+
+  AnalyzerPromptStats *ps = NULL;
+  if (a->prompt != ANALYZER_NO_PROMPT) {
+    ps = &a->prompt_stats[a->prompt];
+    if (ps->reports++ == 0) {
+      memcpy(ps->min, a->rest, sizeof(ps->min));
+      memcpy(ps->max, a->rest, sizeof(ps->max));
+      memcpy(ps->active, a->rest, sizeof(ps->active));
+    }
+  }
+
+  uint8_t prev_old = 0;
+  for (int i = 0; i < length; i++) {
+    uint8_t v = data[i];
+    uint8_t old = a->last[i];
+
+    if (v != old) {
+      AnalyzerByteStats *st = &a->bytes[i];
+      uint8_t step = (uint8_t)(v - old);
+      st->changes++;
+      if (step == a->last_step[i]) st->repeats++;
+      a->last_step[i] = step;
+
+      mark_seen(st, v);
+      if (v < st->min) st->min = v;
+      if (v > st->max) st->max = v;
+
+      for (uint8_t changed = v ^ old; changed; changed &= changed - 1) {
+        int bit = 0;
+        while (!((changed >> bit) & 1)) bit++;
+        st->toggles[bit]++;
+      }
+
+      if (i + 1 < length && data[i + 1] != a->last[i + 1]) st->with_next++;
+
+      // A wrap-around together with a one-step move of a neighbour in the same direction is a carry,
+      // which is what 16-bit values look like from the low byte
+      int wrap = wrap_direction(old, v);
+      if (wrap) {
+        uint8_t carry = wrap > 0 ? 0x01 : 0xFF;
+        if (i + 1 < length && (uint8_t)(data[i + 1] - a->last[i + 1]) == carry) st->carries_next++;
+        if (i > 0 && (uint8_t)(data[i - 1] - prev_old) == carry) st->carries_prev++;
+      }
+    }
+
+    if (ps) {
+      uint8_t diff = v ^ a->rest[i];
+      if (diff) {
+        ps->diff[i] |= diff;
+        ps->active[i] = v;
+      }
+      if (v < ps->min[i]) ps->min[i] = v;
+      if (v > ps->max[i]) ps->max[i] = v;
+    }
+
+    prev_old = old;
+    a->last[i] = v;
+  }
+}
+
+static bool is_counter(const Analyzer *a, int i) {
+  const AnalyzerByteStats *st = &a->bytes[i];
+  uint32_t transitions = a->reports - 1;
+  return st->changes * 100 >= transitions * COUNTER_CHANGE_PCT && st->repeats * 100 >= st->changes * COUNTER_REPEAT_PCT;
+}
+
+static bool is_axis16_pair(const Analyzer *a, int lo, int hi) {
+  const AnalyzerByteStats *l = &a->bytes[lo], *h = &a->bytes[hi];
+  uint32_t together = a->bytes[lo < hi ? lo : hi].with_next;
+  if (lo < hi ? l->carries_next >= AXIS16_MIN_CARRIES : l->carries_prev >= AXIS16_MIN_CARRIES) return true;
+  return !is_counter(a, lo) && h->changes > 0 && l->changes >= h->changes * AXIS16_CHANGE_RATIO &&
+    together * 100 >= h->changes * AXIS16_TOGETHER_PCT && distinct_values(l) >= AXIS16_MIN_DISTINCT;
+}
+
+static bool is_hat_nibble(const Analyzer *a, int i, int shift) {
+  // A hat rests at 8 or 0xF and only ever takes direction values 0-7 besides that
+  uint8_t neutral = (a->rest[i] >> shift) & 0xF;
+  if (neutral != 0x8 && neutral != 0xF) return false;
+
+  uint16_t nibbles = 0;
+  for (int v = 0; v < 256; v++) {
+    if (a->bytes[i].seen[v >> 5] & (1u << (v & 31))) nibbles |= 1 << ((v >> shift) & 0xF);
+  }
+  if (nibbles & ~(0x00FF | (1 << neutral))) return false;
+  return bit_count(nibbles & 0x00FF) >= 2;
+}
+
+static void find_axis(const Analyzer *a, const AnalyzerResult *r, int p, AnalyzerResult *out) {
+  const AnalyzerPrompt *prompt = &a->prompts[p];
+  const AnalyzerPromptStats *ps = &a->prompt_stats[p];
+  int best = -1, best_dev = AXIS_MIN_DEVIATION - 1;
+  bool best_up = false;
+
+  // Pick the axis byte (or high byte of a 16-bit axis) that moved furthest from rest
+  for (int i = 0; i < a->length; i++) {
+    if (r->classes[i] != ANALYZER_CLASS_AXIS8 && r->classes[i] != ANALYZER_CLASS_AXIS16_HI) continue;
+    int up = ps->max[i] - a->rest[i];
+    int down = a->rest[i] - ps->min[i];
+    int dev = up > down ? up : down;
+    if (dev > best_dev) {
+      best = i;
+      best_dev = dev;
+      best_up = up > down;
+    }
+  }
+  if (best < 0) return;
+
+  out->mappings[p].byte = (int8_t)best;
+  out->mappings[p].mask = 0xFF;
+  if (prompt->direction == 0 || prompt->id >= ANALYZER_AXIS_COUNT) return;
+
+  AnalyzerAxisResult *axis = &out->axes[prompt->id];
+  if (axis->found) return;
+  axis->found = true;
+  axis->inverted = (prompt->direction > 0) != best_up;
+
+  if (r->classes[best] == ANALYZER_CLASS_AXIS16_HI) {
+    int lo = (best > 0 && r->classes[best - 1] == ANALYZER_CLASS_AXIS16_LO) ? best - 1 : best + 1;
+    axis->lo = (int8_t)lo;
+    axis->hi = (int8_t)best;
+    axis->centre = (uint16_t)(a->rest[lo] | (a->rest[best] << 8));
+  }
+  else {
+    axis->lo = (int8_t)best;
+    axis->hi = -1;
+    axis->centre = a->rest[best];
+  }
+}
+
+static void find_button(const Analyzer *a, const AnalyzerResult *r, int p, AnalyzerResult *out) {
+  const AnalyzerPromptStats *ps = &a->prompt_stats[p];
+  int best = -1;
+  uint8_t best_mask = 0;
+
+  // Prefer a single bit that changed in a button byte, otherwise take the first byte with any change
+  for (int i = 0; i < a->length; i++) {
+    uint8_t mask = ps->diff[i];
+    if (r->classes[i] == ANALYZER_CLASS_HAT) mask &= ~(0x0F << r->hat.shift);
+    else if (r->classes[i] != ANALYZER_CLASS_BITS) continue;
+    if (!mask) continue;
+    if (bit_count(mask) == 1) {
+      best = i;
+      best_mask = mask;
+      break;
+    }
+    if (best < 0) {
+      best = i;
+      best_mask = mask;
+    }
+  }
+  if (best < 0) return;
+
+  AnalyzerMapping *m = &out->mappings[p];
+  m->byte = (int8_t)best;
+  m->mask = best_mask;
+  m->active_low = (a->rest[best] & best_mask) == best_mask;
+}
+
+void analyzer_infer(const Analyzer *a, AnalyzerResult *r) {
+  memset(r, 0, sizeof(*r));
+  r->hat.byte = -1;
+  for (int i = 0; i < ANALYZER_AXIS_COUNT; i++) r->axes[i].lo = r->axes[i].hi = -1;
+  for (int p = 0; p < ANALYZER_MAX_PROMPTS; p++) r->mappings[p].byte = -1;
+  if (a->reports < 2) return;
+
+  bool done[ANALYZER_MAX_REPORT] = {false};
+
+  // Pair up 16-bit values first, since their low bytes look like noise on their own
+  for (int i = 0; i + 1 < a->length; i++) {
+    if (done[i] || done[i + 1]) continue;
+    int lo = -1, hi = -1;
+    if (is_axis16_pair(a, i, i + 1)) { lo = i; hi = i + 1; }
+    else if (is_axis16_pair(a, i + 1, i)) { lo = i + 1; hi = i; }
+    if (lo < 0) continue;
+
+    // 16-bit timestamps carry too, but step evenly
+    bool counter = is_counter(a, lo);
+    r->classes[lo] = counter ? ANALYZER_CLASS_COUNTER : ANALYZER_CLASS_AXIS16_LO;
+    r->classes[hi] = counter ? ANALYZER_CLASS_COUNTER : ANALYZER_CLASS_AXIS16_HI;
+    done[lo] = done[hi] = true;
+  }
+
+  // Classify the remaining bytes on their own
+  for (int i = 0; i < a->length; i++) {
+    if (done[i]) continue;
+    const AnalyzerByteStats *st = &a->bytes[i];
+    if (st->changes == 0) {
+      r->classes[i] = ANALYZER_CLASS_CONSTANT;
+    }
+    else if (is_counter(a, i)) {
+      r->classes[i] = ANALYZER_CLASS_COUNTER;
+    }
+    else if (!r->hat.found && (is_hat_nibble(a, i, 0) || is_hat_nibble(a, i, 4))) {
+      r->classes[i] = ANALYZER_CLASS_HAT;
+      r->hat.found = true;
+      r->hat.byte = (int8_t)i;
+      r->hat.shift = is_hat_nibble(a, i, 0) ? 0 : 4;
+      r->hat.neutral = (a->rest[i] >> r->hat.shift) & 0xF;
+    }
+    else if (distinct_values(st) >= AXIS8_MIN_DISTINCT && toggled_bits(st) >= AXIS8_MIN_BITS) {
+      r->classes[i] = ANALYZER_CLASS_AXIS8;
+    }
+    else {
+      r->classes[i] = ANALYZER_CLASS_BITS;
+    }
+  }
+
+  // Label what changed during each prompt
+  for (int p = 0; p < a->prompt_count; p++) {
+    const AnalyzerPromptStats *ps = &a->prompt_stats[p];
+    if (!ps->reports) continue;
+
+    switch (a->prompts[p].kind) {
+      case ANALYZER_KIND_HAT:
+        if (r->hat.found && (ps->diff[r->hat.byte] & (0x0F << r->hat.shift))) {
+          AnalyzerMapping *m = &r->mappings[p];
+          m->byte = r->hat.byte;
+          m->mask = 0x0F << r->hat.shift;
+          m->value = (ps->active[r->hat.byte] >> r->hat.shift) & 0xF;
+          break;
+        }
+        // D-pads without a hat report directions as separate buttons
+        find_button(a, r, p, r);
+        break;
+
+      case ANALYZER_KIND_BUTTON:
+        find_button(a, r, p, r);
+        break;
+
+      case ANALYZER_KIND_AXIS:
+        find_axis(a, r, p, r);
+        break;
+    }
+  }
+}
+
+#define APPEND(...) \
+  do { \
+    if (n < cap) { \
+      int w = snprintf(out + n, (size_t)(cap - n), __VA_ARGS__); \
+      if (w > 0) n += w; \
+    } \
+  } while (0)
+
+int analyzer_describe(const Analyzer *a, const AnalyzerResult *r, char *out, int cap) {
+  int n = 0;
+  if (cap <= 0) return 0;
+  out[0] = 0;
+
+  APPEND("Reports analyzed: %u (length %d)\n", (unsigned)a->reports, a->length);
+  if (a->reports < 2) return n < cap ? n : cap - 1;
+
+  // Layout inferred from the statistics alone
+  for (int i = 0; i < a->length; i++) {
+    const AnalyzerByteStats *st = &a->bytes[i];
+    switch (r->classes[i]) {
+      case ANALYZER_CLASS_BITS:
+        APPEND("byte %d: buttons, bits 0x%02X (rest 0x%02X)\n", i, toggled_mask(st), a->rest[i]);
+        break;
+      case ANALYZER_CLASS_HAT:
+        APPEND("byte %d: hat in %s nibble, neutral %X\n", i, r->hat.shift ? "high" : "low", r->hat.neutral);
+        break;
+      case ANALYZER_CLASS_AXIS8:
+        APPEND("byte %d: 8-bit axis, centre 0x%02X, range 0x%02X-0x%02X\n", i, a->rest[i], st->min, st->max);
+        break;
+      case ANALYZER_CLASS_AXIS16_LO:
+      {
+        bool little = i + 1 < a->length && r->classes[i + 1] == ANALYZER_CLASS_AXIS16_HI &&
+          (i == 0 || r->classes[i - 1] != ANALYZER_CLASS_AXIS16_HI || is_axis16_pair(a, i, i + 1));
+        int hi = little ? i + 1 : i - 1;
+        APPEND("bytes %d-%d: 16-bit axis, %s-endian, centre 0x%04X\n", little ? i : hi, little ? hi : i,
+          little ? "little" : "big", a->rest[i] | (a->rest[hi] << 8));
+        break;
+      }
+      case ANALYZER_CLASS_COUNTER:
+        APPEND("byte %d: counter\n", i);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Labels from the prompts
+  for (int p = 0; p < a->prompt_count; p++) {
+    const AnalyzerPrompt *prompt = &a->prompts[p];
+    const AnalyzerMapping *m = &r->mappings[p];
+    if (prompt->kind == ANALYZER_KIND_NONE) continue;
+
+    if (m->byte < 0) {
+      APPEND("%s: not found\n", prompt->name);
+    }
+    else if (prompt->kind == ANALYZER_KIND_HAT && m->mask == (0x0F << r->hat.shift) && m->byte == r->hat.byte) {
+      APPEND("%s: hat %s = %X\n", prompt->name, HAT_NAMES[prompt->id % ANALYZER_HAT_COUNT], m->value);
+    }
+    else if (prompt->kind == ANALYZER_KIND_AXIS) {
+      APPEND("%s: moves byte %d\n", prompt->name, m->byte);
+    }
+    else {
+      APPEND("%s: byte %d mask 0x%02X (active %s)\n", prompt->name, m->byte, m->mask, m->active_low ? "low" : "high");
+    }
+  }
+
+  for (int i = 0; i < ANALYZER_AXIS_COUNT; i++) {
+    const AnalyzerAxisResult *axis = &r->axes[i];
+    if (!axis->found) continue;
+    if (axis->hi < 0)
+      APPEND("%s: byte %d, centre 0x%02X%s\n", AXIS_NAMES[i], axis->lo, axis->centre, axis->inverted ? ", inverted" : "");
+    else
+      APPEND("%s: bytes %d (low) and %d (high), centre 0x%04X%s\n", AXIS_NAMES[i], axis->lo, axis->hi, axis->centre,
+        axis->inverted ? ", inverted" : "");
+  }
+
+  return n < cap ? n : cap - 1;
+}
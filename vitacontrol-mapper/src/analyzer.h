@@ -0,0 +1,134 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Streaming analyzer for raw input reports.
+// Every report in a session is folded into per-byte and per-bit statistics in a single pass, and the controller
+// layout (buttons, hat, axes, endianness and centres) is inferred from them afterwards. Reports can optionally be
+// tagged with the prompt that was on screen, to label what was found. Plain C so it also builds into host tools.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Report bytes that are analyzed, and the most prompts a session can have
+#define ANALYZER_MAX_REPORT  64
+#define ANALYZER_MAX_PROMPTS 32
+#define ANALYZER_NO_PROMPT   -1
+
+typedef enum AnalyzerKind {
+  ANALYZER_KIND_NONE,
+  ANALYZER_KIND_BUTTON,
+  ANALYZER_KIND_HAT,
+  ANALYZER_KIND_AXIS,
+} AnalyzerKind;
+
+typedef enum AnalyzerAxis {
+  ANALYZER_AXIS_LX,
+  ANALYZER_AXIS_LY,
+  ANALYZER_AXIS_RX,
+  ANALYZER_AXIS_RY,
+  ANALYZER_AXIS_COUNT,
+} AnalyzerAxis;
+
+typedef enum AnalyzerHatDir {
+  ANALYZER_HAT_UP,
+  ANALYZER_HAT_RIGHT,
+  ANALYZER_HAT_DOWN,
+  ANALYZER_HAT_LEFT,
+  ANALYZER_HAT_COUNT,
+} AnalyzerHatDir;
+
+typedef enum AnalyzerClass {
+  ANALYZER_CLASS_CONSTANT,
+  ANALYZER_CLASS_BITS,
+  ANALYZER_CLASS_HAT,
+  ANALYZER_CLASS_AXIS8,
+  ANALYZER_CLASS_AXIS16_LO,
+  ANALYZER_CLASS_AXIS16_HI,
+  ANALYZER_CLASS_COUNTER,
+} AnalyzerClass;
+
+// What the user was asked to do while reports were tagged with a prompt
+typedef struct AnalyzerPrompt {
+  const char *name;
+  uint8_t kind;      // AnalyzerKind
+  uint8_t id;        // AnalyzerHatDir or AnalyzerAxis, for those kinds
+  int8_t direction;  // Axis direction: -1 (up/left), 1 (down/right), or 0 if any direction goes
+} AnalyzerPrompt;
+
+typedef struct AnalyzerByteStats {
+  uint32_t changes;      // Reports where the byte changed
+  uint32_t repeats;      // Changes by the same step as the previous change (counters)
+  uint32_t carries_next; // Wrapped around while the next byte moved by one the same way (little-endian low byte)
+  uint32_t carries_prev; // Wrapped around while the previous byte moved by one the same way (big-endian low byte)
+  uint32_t with_next;    // Changed in the same report as the next byte
+  uint32_t toggles[8];   // Changes of each bit
+  uint32_t seen[8];      // Bitmap of every value seen
+  uint8_t min, max;
+} AnalyzerByteStats;
+
+typedef struct AnalyzerPromptStats {
+  uint32_t reports;
+  uint8_t diff[ANALYZER_MAX_REPORT];   // Bits that differed from rest at some point
+  uint8_t active[ANALYZER_MAX_REPORT]; // Last value that differed from rest
+  uint8_t min[ANALYZER_MAX_REPORT];
+  uint8_t max[ANALYZER_MAX_REPORT];
+} AnalyzerPromptStats;
+
+typedef struct Analyzer {
+  uint32_t reports;
+  int length;
+  int prompt;
+  int prompt_count;
+  const AnalyzerPrompt *prompts;
+  uint8_t rest[ANALYZER_MAX_REPORT];
+  uint8_t last[ANALYZER_MAX_REPORT];
+  uint8_t last_step[ANALYZER_MAX_REPORT];
+  AnalyzerByteStats bytes[ANALYZER_MAX_REPORT];
+  AnalyzerPromptStats prompt_stats[ANALYZER_MAX_PROMPTS];
+} Analyzer;
+
+typedef struct AnalyzerAxisResult {
+  bool found;
+  int8_t lo, hi;     // Byte indices; hi is -1 for 8-bit axes
+  uint16_t centre;
+  bool inverted;     // Value decreases towards down/right
+} AnalyzerAxisResult;
+
+typedef struct AnalyzerHatResult {
+  bool found;
+  int8_t byte;
+  uint8_t shift;     // 0 for the low nibble, 4 for the high one
+  uint8_t neutral;
+} AnalyzerHatResult;
+
+typedef struct AnalyzerMapping {
+  int8_t byte;       // -1 if nothing was found
+  uint8_t mask;      // Bits of a button, or the nibble mask of a hat direction
+  uint8_t value;     // Hat value, for hat directions
+  bool active_low;
+} AnalyzerMapping;
+
+typedef struct AnalyzerResult {
+  uint8_t classes[ANALYZER_MAX_REPORT]; // AnalyzerClass
+  AnalyzerHatResult hat;
+  AnalyzerAxisResult axes[ANALYZER_AXIS_COUNT];
+  AnalyzerMapping mappings[ANALYZER_MAX_PROMPTS];
+} AnalyzerResult;
+
+void analyzer_init(Analyzer *a, const AnalyzerPrompt *prompts, int prompt_count);
+void analyzer_set_prompt(Analyzer *a, int prompt);
+void analyzer_ingest(Analyzer *a, const uint8_t *data, int length);
+void analyzer_infer(const Analyzer *a, AnalyzerResult *result);
+
+// Write a human-readable summary of the result; returns the number of characters written
+int analyzer_describe(const Analyzer *a, const AnalyzerResult *result, char *out, int cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ANALYZER_H
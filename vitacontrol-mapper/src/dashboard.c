@@ -0,0 +1,146 @@
+#include <psp2/display.h>
+#include <psp2/touch.h>
+
+#include "dashboard.h"
+#include "debugScreen.h"
+#include "vitacontrol.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_SLOTS 4
+
+// Rates and percentiles are computed over windows of this many frames (about a second)
+#define WINDOW_FRAMES 60
+
+static const char *const HOOK_NAMES[VITACONTROL_HOOK_COUNT] = {"ctrl", "touch", "motion"};
+
+typedef struct SlotWindow {
+  uint32_t report_rate;
+  uint32_t dropped;
+  uint32_t late;
+  uint32_t decode_avg_ns;
+  uint32_t interval_p50, interval_p99;
+  uint32_t latency_p50, latency_p95, latency_p99;
+} SlotWindow;
+
+// Snapshots at the start and end of the current window, and what was computed for the last full window
+static VitacontrolStats window_start;
+static VitacontrolStats current;
+static SlotWindow windows[MAX_SLOTS];
+static uint32_t hook_rates[VITACONTROL_HOOK_COUNT];
+
+static uint32_t percentile(const uint32_t *now, const uint32_t *before, uint32_t pct) {
+  // Walk the histogram of what changed in the window, and return the upper edge of the bucket holding the percentile
+  uint32_t total = 0;
+  for (int i = 0; i < VITACONTROL_STATS_BUCKETS; i++) total += now[i] - before[i];
+  if (total == 0) return 0;
+
+  uint32_t target = (total * pct + 99) / 100;
+  uint32_t count = 0;
+  for (int i = 0; i < VITACONTROL_STATS_BUCKETS; i++) {
+    count += now[i] - before[i];
+    if (count >= target) return (uint32_t)(i + 1) * VITACONTROL_STATS_BUCKET_US;
+  }
+  return VITACONTROL_STATS_BUCKETS * VITACONTROL_STATS_BUCKET_US;
+}
+
+static void close_window(void) {
+  uint32_t elapsed = (uint32_t)(current.time - window_start.time);
+  if (elapsed == 0) return;
+
+  for (int h = 0; h < VITACONTROL_HOOK_COUNT; h++)
+    hook_rates[h] = (uint32_t)((uint64_t)(current.hookCalls[h] - window_start.hookCalls[h]) * 1000000 / elapsed);
+
+  for (int i = 0; i < MAX_SLOTS; i++) {
+    const VitacontrolSlotStats *now = &current.slots[i];
+    const VitacontrolSlotStats *before = &window_start.slots[i];
+    SlotWindow *w = &windows[i];
+    memset(w, 0, sizeof(*w));
+
+    // Counters restart when a controller connects, so skip windows where that happened
+    if (!now->connected || now->reports < before->reports) continue;
+
+    uint32_t reports = now->reports - before->reports;
+    w->report_rate = (uint32_t)((uint64_t)reports * 1000000 / elapsed);
+    w->dropped = now->droppedReports - before->droppedReports;
+    w->late = now->lateReports - before->lateReports;
+    if (reports) w->decode_avg_ns = (uint32_t)((uint64_t)(now->decodeTime - before->decodeTime) * 1000 / reports);
+    w->interval_p50 = percentile(now->intervals, before->intervals, 50);
+    w->interval_p99 = percentile(now->intervals, before->intervals, 99);
+    w->latency_p50 = percentile(now->latencies, before->latencies, 50);
+    w->latency_p95 = percentile(now->latencies, before->latencies, 95);
+    w->latency_p99 = percentile(now->latencies, before->latencies, 99);
+  }
+
+  window_start = current;
+}
+
+static void draw(void) {
+  // Only text cells that changed since the previous frame are redrawn
+  psvDebugScreenBeginFrame();
+  psvDebugScreenPrintf("VitaControl Dashboard (tap to exit)\n\n");
+  psvDebugScreenPrintf("Hooks/s:");
+  for (int h = 0; h < VITACONTROL_HOOK_COUNT; h++) psvDebugScreenPrintf(" %s %u", HOOK_NAMES[h], (unsigned)hook_rates[h]);
+  psvDebugScreenPrintf("\n");
+  psvDebugScreenPrintf("Log drops: raw %u, capture %u\n",
+                       (unsigned)current.rawLogDropped, (unsigned)current.captureDropped);
+
+  for (int i = 0; i < MAX_SLOTS; i++) {
+    const VitacontrolSlotStats *s = &current.slots[i];
+    const SlotWindow *w = &windows[i];
+    psvDebugScreenPrintf("\n");
+    if (!s->connected) {
+      psvDebugScreenPrintf("Slot %d: not connected\n\n\n\n", i);
+      continue;
+    }
+
+    psvDebugScreenPrintf("Slot %d: %u reports/s (%u total) first input %u.%ums%s\n", i, (unsigned)w->report_rate,
+                         (unsigned)s->reports, (unsigned)(s->firstInputTime / 1000),
+                         (unsigned)(s->firstInputTime % 1000 / 100), s->cached ? " cached" : "");
+    psvDebugScreenPrintf("  interval %u.%uus p50 %u p99 %u jitter %u.%uus\n",
+                         (unsigned)(s->averageInterval >> 4), (unsigned)((s->averageInterval & 15) * 10 / 16),
+                         (unsigned)w->interval_p50, (unsigned)w->interval_p99,
+                         (unsigned)(s->jitter >> 4), (unsigned)((s->jitter & 15) * 10 / 16));
+    psvDebugScreenPrintf("  drop %u/s (%u) late %u/s (%u) decode %uns max %uus\n",
+                         (unsigned)w->dropped, (unsigned)s->droppedReports, (unsigned)w->late, (unsigned)s->lateReports,
+                         (unsigned)w->decode_avg_ns, (unsigned)s->decodeTimeMax);
+    psvDebugScreenPrintf("  latency p50 %uus p95 %uus p99 %uus\n",
+                         (unsigned)w->latency_p50, (unsigned)w->latency_p95, (unsigned)w->latency_p99);
+  }
+  psvDebugScreenEndFrame();
+}
+
+static bool touched(void) {
+  SceTouchData touch;
+  sceTouchPeek(SCE_TOUCH_PORT_FRONT, &touch, 1);
+  return touch.reportNum > 0;
+}
+
+void dashboard_run(void) {
+  psvDebugScreenBeginFrame();
+
+  if (vitacontrolGetStats(&current) < 0) {
+    psvDebugScreenPrintf("ERROR: couldn't read the plugin's statistics\n");
+    psvDebugScreenPrintf("Is VitaControl updated and loaded?\n");
+    psvDebugScreenEndFrame();
+    while (!touched()) sceDisplayWaitVblankStart();
+    while (touched()) sceDisplayWaitVblankStart();
+    return;
+  }
+  window_start = current;
+  memset(windows, 0, sizeof(windows));
+  memset(hook_rates, 0, sizeof(hook_rates));
+
+  // Refresh once per frame; rates and percentiles update once per window
+  for (int frame = 1; !touched(); frame++) {
+    sceDisplayWaitVblankStart();
+    vitacontrolGetStats(&current);
+    if (frame % WINDOW_FRAMES == 0) close_window();
+    draw();
+  }
+
+  // Wait for release to avoid double-trigger
+  while (touched()) sceDisplayWaitVblankStart();
+}
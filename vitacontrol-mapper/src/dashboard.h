@@ -0,0 +1,7 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+// Live view of the plugin's performance counters, refreshed every frame until the touchscreen is tapped
+void dashboard_run(void);
+
+#endif // DASHBOARD_H
@@ -4,75 +4,109 @@
 #include <psp2/kernel/processmgr.h>
 #include <psp2/kernel/threadmgr.h>
 
+#include "analyzer.h"
+#include "dashboard.h"
 #include "debugScreen.h"
+#include "vitacontrol.h"
 
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-#define RAW_LOG_PATH  "ux0:data/vitacontrol_mapper_raw.txt"
 #define OUT_LOG_PATH  "ux0:data/vitacontrol_mapper_results.txt"
 
+// Capture records fetched per syscall, and how long each read waits for new reports
+#define CAPTURE_BATCH    32
+#define CAPTURE_WAIT_US  100000
+
+// Report bytes compared and shown in delta lines (indices stay within 2 digits)
+#define DELTA_BYTES 64
+#define MAX_SLOTS   4
+
 typedef struct Step {
   const char *name;
   const char *prompt;
+  uint8_t kind;      // What the analyzer should look for (AnalyzerKind)
+  uint8_t id;        // Hat direction or axis
+  int8_t direction;  // Axis direction
 } Step;
 
+#define BUTTON             ANALYZER_KIND_BUTTON, 0, 0
+#define HAT(dir)           ANALYZER_KIND_HAT, ANALYZER_HAT_##dir, 0
+#define AXIS(axis, dir)    ANALYZER_KIND_AXIS, ANALYZER_AXIS_##axis, dir
+
 static const Step STEPS[] = {
   // Physical button labels on the 8BitDo Lite 2 (D-input), with expected Vita mapping
-  {"A",           "Press A (expected Vita: CIRCLE)"},
-  {"B",           "Press B (expected Vita: CROSS)"},
-  {"X",           "Press X (expected Vita: TRIANGLE)"},
-  {"Y",           "Press Y (expected Vita: SQUARE)"},
-
-  {"DPAD_UP",     "Press D-PAD UP"},
-  {"DPAD_RIGHT",  "Press D-PAD RIGHT"},
-  {"DPAD_DOWN",   "Press D-PAD DOWN"},
-  {"DPAD_LEFT",   "Press D-PAD LEFT"},
-
-  {"L1",          "Press L1 (small bumper; expected Vita: L1 / secondary)"},
-  {"R1",          "Press R1 (small bumper; expected Vita: R1 / secondary)"},
-  {"L2",          "Press L2 (big shoulder; expected Vita: LTRIGGER / Left shoulder)"},
-  {"R2",          "Press R2 (big shoulder; expected Vita: RTRIGGER / Right shoulder)"},
-
-  {"L3",          "Press L3 (left stick click)"},
-  {"R3",          "Press R3 (right stick click)"},
-
-  {"START",       "Press START / PLUS"},
-  {"SELECT",      "Press SELECT / MINUS"},
-
-  {"HOME",        "Press HOME (expected Vita: PS button) - optional"},
-
-  {"STICK_L",     "Move LEFT stick a bit (any direction)"},
-  {"LS_UP",       "LEFT stick: push UP and hold briefly"},
-  {"LS_RIGHT",    "LEFT stick: push RIGHT and hold briefly"},
-  {"LS_DOWN",     "LEFT stick: push DOWN and hold briefly"},
-  {"LS_LEFT",     "LEFT stick: push LEFT and hold briefly"},
-
-  {"STICK_R",     "Move RIGHT stick a bit (any direction)"},
-  {"RS_UP",       "RIGHT stick: push UP and hold briefly"},
-  {"RS_RIGHT",    "RIGHT stick: push RIGHT and hold briefly"},
-  {"RS_DOWN",     "RIGHT stick: push DOWN and hold briefly"},
-  {"RS_LEFT",     "RIGHT stick: push LEFT and hold briefly"},
+  {"A",           "Press A (expected Vita: CIRCLE)", BUTTON},
+  {"B",           "Press B (expected Vita: CROSS)", BUTTON},
+  {"X",           "Press X (expected Vita: TRIANGLE)", BUTTON},
+  {"Y",           "Press Y (expected Vita: SQUARE)", BUTTON},
+
+  {"DPAD_UP",     "Press D-PAD UP", HAT(UP)},
+  {"DPAD_RIGHT",  "Press D-PAD RIGHT", HAT(RIGHT)},
+  {"DPAD_DOWN",   "Press D-PAD DOWN", HAT(DOWN)},
+  {"DPAD_LEFT",   "Press D-PAD LEFT", HAT(LEFT)},
+
+  {"L1",          "Press L1 (small bumper; expected Vita: L1 / secondary)", BUTTON},
+  {"R1",          "Press R1 (small bumper; expected Vita: R1 / secondary)", BUTTON},
+  {"L2",          "Press L2 (big shoulder; expected Vita: LTRIGGER / Left shoulder)", BUTTON},
+  {"R2",          "Press R2 (big shoulder; expected Vita: RTRIGGER / Right shoulder)", BUTTON},
+
+  {"L3",          "Press L3 (left stick click)", BUTTON},
+  {"R3",          "Press R3 (right stick click)", BUTTON},
+
+  {"START",       "Press START / PLUS", BUTTON},
+  {"SELECT",      "Press SELECT / MINUS", BUTTON},
+
+  {"HOME",        "Press HOME (expected Vita: PS button) - optional", BUTTON},
+
+  {"STICK_L",     "Move LEFT stick a bit (any direction)", AXIS(LX, 0)},
+  {"LS_UP",       "LEFT stick: push UP and hold briefly", AXIS(LY, -1)},
+  {"LS_RIGHT",    "LEFT stick: push RIGHT and hold briefly", AXIS(LX, 1)},
+  {"LS_DOWN",     "LEFT stick: push DOWN and hold briefly", AXIS(LY, 1)},
+  {"LS_LEFT",     "LEFT stick: push LEFT and hold briefly", AXIS(LX, -1)},
+
+  {"STICK_R",     "Move RIGHT stick a bit (any direction)", AXIS(RX, 0)},
+  {"RS_UP",       "RIGHT stick: push UP and hold briefly", AXIS(RY, -1)},
+  {"RS_RIGHT",    "RIGHT stick: push RIGHT and hold briefly", AXIS(RX, 1)},
+  {"RS_DOWN",     "RIGHT stick: push DOWN and hold briefly", AXIS(RY, 1)},
+  {"RS_LEFT",     "RIGHT stick: push LEFT and hold briefly", AXIS(RX, -1)},
 };
 
+#define STEP_COUNT ((int)(sizeof(STEPS) / sizeof(STEPS[0])))
+
+// Every captured report from the mapped controller goes through the analyzer, tagged with the current step
+static Analyzer analyzer;
+static AnalyzerPrompt analyzer_prompts[STEP_COUNT];
+static AnalyzerResult analyzer_result;
+static char analyzer_text[4096];
+static int analyzer_slot = -1;
+
 static void clear_screen(void) {
-  psvDebugScreenClear(0x000000);
+  // Text that's printed again in the same place isn't redrawn; the rest is cleared by show_screen()
+  psvDebugScreenBeginFrame();
 }
 
-static void wait_for_tap(void) {
+static void show_screen(void) {
+  psvDebugScreenEndFrame();
+}
+
+static int wait_for_tap(void) {
+  // Returns the vertical position of the tap (0-1087 on the front touchscreen)
   SceTouchData touch;
+  show_screen();
   while (true) {
     sceTouchPeek(SCE_TOUCH_PORT_FRONT, &touch, 1);
     if (touch.reportNum > 0) {
+      int y = touch.report[0].y;
       // wait for release to avoid double-trigger
       while (true) {
         sceTouchPeek(SCE_TOUCH_PORT_FRONT, &touch, 1);
         if (touch.reportNum == 0) break;
         sceKernelDelayThread(16 * 1000);
       }
-      return;
+      return y;
     }
     sceKernelDelayThread(16 * 1000);
   }
@@ -83,41 +117,115 @@ static int open_out_log(void) {
   if (fd >= 0) {
     const char *hdr =
       "VitaControl Mapper Results\n"
-      "Source raw log: " RAW_LOG_PATH "\n"
+      "Source: VitaControl raw report capture\n"
       "Format: STEP_NAME\tRAW_LINE\n\n";
     sceIoWrite(fd, hdr, (unsigned)strlen(hdr));
   }
   return fd;
 }
 
-static bool read_next_line(int fd, char *out, int out_cap) {
-  // Read until newline. The kernel module writes newline-terminated records.
-  int n = 0;
-  while (n < out_cap - 1) {
-    char ch;
-    int r = sceIoRead(fd, &ch, 1);
-    if (r <= 0) {
-      return false;
-    }
-    out[n++] = ch;
-    if (ch == '\n') break;
+typedef struct SlotBaseline {
+  bool valid;
+  uint8_t data[DELTA_BYTES];
+} SlotBaseline;
+
+static VitacontrolCaptureRecord capture_records[CAPTURE_BATCH];
+static SlotBaseline baselines[MAX_SLOTS];
+
+static int format_delta_line(const VitacontrolCaptureRecord *rec, const uint8_t *last, char *line, int line_cap) {
+  // Same format the kernel's text raw log uses:
+  // id=.. b1=.. b2=.. b3=.. b4=.. b5=.. b6=.. b7=.. ch=[idx:old>new,...]\n
+  int max_bytes = rec->length < DELTA_BYTES ? rec->length : DELTA_BYTES;
+  const uint8_t *buf = rec->data;
+  int n = snprintf(line, line_cap, "id=%02X", buf[0]);
+  if (max_bytes >= 8) {
+    n += snprintf(line + n, line_cap - n, " b1=%02X b2=%02X b3=%02X b4=%02X b5=%02X b6=%02X b7=%02X",
+                  buf[1], buf[2], buf[3], buf[4], buf[5], buf[6], buf[7]);
+  }
+  n += snprintf(line + n, line_cap - n, " ch=[");
+  bool first = true;
+  for (int i = 0; i < max_bytes && n < line_cap - 16; i++) {
+    if (last[i] == buf[i]) continue;
+    n += snprintf(line + n, line_cap - n, "%s%d:%02X>%02X", first ? "" : ",", i, last[i], buf[i]);
+    first = false;
+  }
+  n += snprintf(line + n, line_cap - n, "]\n");
+  return n;
+}
+
+static bool apply_record(const VitacontrolCaptureRecord *rec, char *line, int line_cap) {
+  // Update the slot's baseline, and format a delta line if the report changed.
+  // The first report of a slot only sets the baseline.
+  if (rec->slot >= MAX_SLOTS || rec->length == 0) return false;
+
+  // Analyze the first controller that sends anything
+  if (analyzer_slot < 0) analyzer_slot = rec->slot;
+  if (rec->slot == analyzer_slot) analyzer_ingest(&analyzer, rec->data, rec->length);
+
+  SlotBaseline *base = &baselines[rec->slot];
+  int max_bytes = rec->length < DELTA_BYTES ? rec->length : DELTA_BYTES;
+
+  bool changed = false;
+  if (base->valid) {
+    changed = memcmp(base->data, rec->data, (size_t)max_bytes) != 0;
+    if (changed && line) format_delta_line(rec, base->data, line, line_cap);
+  }
+
+  memcpy(base->data, rec->data, (size_t)max_bytes);
+  base->valid = true;
+  return changed;
+}
+
+static void drain_capture(void) {
+  // Fold everything captured so far into the baselines (e.g. the button release from the previous step)
+  // so the next step only captures deltas that happen AFTER the prompt.
+  int n;
+  while ((n = vitacontrolReadCapture(capture_records, CAPTURE_BATCH, 0)) > 0) {
+    for (int i = 0; i < n; i++) apply_record(&capture_records[i], NULL, 0);
   }
-  out[n] = 0;
-  return true;
 }
 
-static void wait_for_new_raw_line(int raw_fd, char *line, int line_cap) {
-  // The raw log is append-only during a session.
-  // We poll until we can read a full newline-terminated line.
+static void wait_for_new_delta(char *line, int line_cap) {
+  // Block in the kernel until reports arrive, and stop at the first one that changed.
+  // Anything after it in the same batch still updates the baselines.
+  show_screen();
   while (true) {
-    if (read_next_line(raw_fd, line, line_cap)) {
-      return;
+    int n = vitacontrolReadCapture(capture_records, CAPTURE_BATCH, CAPTURE_WAIT_US);
+    if (n < 0) {
+      // The plugin went away or the read failed; don't spin.
+      sceKernelDelayThread(50 * 1000);
+      continue;
     }
-    // No new data yet — wait a bit and retry.
-    sceKernelDelayThread(50 * 1000);
+    bool found = false;
+    for (int i = 0; i < n; i++) {
+      if (found) apply_record(&capture_records[i], NULL, 0);
+      else found = apply_record(&capture_records[i], line, line_cap);
+    }
+    if (found) return;
   }
 }
 
+static void pause_and_capture(int ms) {
+  // Keep feeding the analyzer while the captured line is on screen (the user is usually still holding the input)
+  for (int t = 0; t < ms; t += CAPTURE_WAIT_US / 1000) {
+    int n = vitacontrolReadCapture(capture_records, CAPTURE_BATCH, CAPTURE_WAIT_US);
+    for (int i = 0; i < n; i++) apply_record(&capture_records[i], NULL, 0);
+    if (n < 0) sceKernelDelayThread(CAPTURE_WAIT_US);
+  }
+}
+
+static void write_analysis(int out_fd) {
+  analyzer_infer(&analyzer, &analyzer_result);
+  int n = analyzer_describe(&analyzer, &analyzer_result, analyzer_text, (int)sizeof(analyzer_text));
+  if (out_fd < 0) return;
+  const char *hdr = "\nInferred layout (slot ";
+  char slot[8];
+  int slot_len = snprintf(slot, sizeof(slot), "%d):\n", analyzer_slot < 0 ? 0 : analyzer_slot);
+  sceIoWrite(out_fd, hdr, (unsigned)strlen(hdr));
+  sceIoWrite(out_fd, slot, (unsigned)slot_len);
+  sceIoWrite(out_fd, analyzer_text, (unsigned)n);
+}
+
 static void write_step_result(int out_fd, const char *step_name, const char *raw_line) {
   if (out_fd < 0) return;
   sceIoWrite(out_fd, step_name, (unsigned)strlen(step_name));
@@ -130,34 +238,42 @@ int main(void) {
   sceTouchSetSamplingState(SCE_TOUCH_PORT_FRONT, SCE_TOUCH_SAMPLING_STATE_START);
   psvDebugScreenInit();
 
-  clear_screen();
   // Bigger text: 2x font scaling (more readable, fewer chars per line)
   psvDebugScreenSetFont(psvDebugScreenScaleFont2x(psvDebugScreenGetFont()));
 
   psvDebugScreenPrintf("VitaControl Mapper\n\n");
-  psvDebugScreenPrintf("This app watches: %s\n", RAW_LOG_PATH);
-  psvDebugScreenPrintf("and writes:       %s\n\n", OUT_LOG_PATH);
+  psvDebugScreenPrintf("This app captures raw reports from VitaControl\n");
+  psvDebugScreenPrintf("and writes: %s\n\n", OUT_LOG_PATH);
   psvDebugScreenPrintf("Make sure VitaControl is installed and the controller is connected.\n");
-  psvDebugScreenPrintf("Tap the front touchscreen to begin.\n");
-  wait_for_tap();
+  psvDebugScreenPrintf("Tap the top half of the front touchscreen to begin mapping,\n");
+  psvDebugScreenPrintf("or the bottom half for the performance dashboard.\n");
+  if (wait_for_tap() >= 544) {
+    dashboard_run();
+    sceKernelExitProcess(0);
+    return 0;
+  }
 
   int out_fd = open_out_log();
 
-  // Open raw log and seek to end so each step captures the *next* delta line.
-  int raw_fd = sceIoOpen(RAW_LOG_PATH, SCE_O_RDONLY, 0);
-  if (raw_fd < 0) {
+  for (int i = 0; i < STEP_COUNT; i++) {
+    AnalyzerPrompt prompt = {STEPS[i].name, STEPS[i].kind, STEPS[i].id, STEPS[i].direction};
+    analyzer_prompts[i] = prompt;
+  }
+  analyzer_init(&analyzer, analyzer_prompts, STEP_COUNT);
+
+  // Ask the kernel module to start capturing raw reports into its in-memory ring.
+  if (vitacontrolSetCapture(1) < 0) {
     clear_screen();
-    psvDebugScreenPrintf("ERROR: couldn't open %s\n", RAW_LOG_PATH);
+    psvDebugScreenPrintf("ERROR: couldn't start the raw report capture\n");
     psvDebugScreenPrintf("Is VitaControl updated and loaded?\n");
     psvDebugScreenPrintf("\nTap the front touchscreen to exit.\n");
     wait_for_tap();
+    if (out_fd >= 0) sceIoClose(out_fd);
     sceKernelExitProcess(0);
     return 0;
   }
 
-  sceIoLseek(raw_fd, 0, SCE_SEEK_END);
-
-  const int steps_total = (int)(sizeof(STEPS) / sizeof(STEPS[0]));
+  const int steps_total = STEP_COUNT;
   char line[256];
 
   for (int i = 0; i < steps_total; i++) {
@@ -165,14 +281,12 @@ int main(void) {
     psvDebugScreenPrintf("Step %d / %d\n\n", i + 1, steps_total);
     psvDebugScreenPrintf("%s\n\n", STEPS[i].prompt);
     psvDebugScreenPrintf("Now press the button / do the action on the Lite 2.\n");
-    psvDebugScreenPrintf("Waiting for a new raw log line...\n");
-
-    // Flush any pending raw lines (e.g. button release from previous step)
-    // so this step only captures deltas that happen AFTER the prompt.
-    sceIoLseek(raw_fd, 0, SCE_SEEK_END);
+    psvDebugScreenPrintf("Waiting for a new raw report...\n");
 
-    // Wait for the kernel module to append the next delta line.
-    wait_for_new_raw_line(raw_fd, line, (int)sizeof(line));
+    // Skip anything captured before the prompt, then wait for the next changed report.
+    drain_capture();
+    analyzer_set_prompt(&analyzer, i);
+    wait_for_new_delta(line, (int)sizeof(line));
 
     // Show what we captured and write it to the output file.
     psvDebugScreenPrintf("\nCaptured:\n%s\n", line);
@@ -180,18 +294,19 @@ int main(void) {
 
     // Auto-advance after a short pause so the user can see what was captured.
     psvDebugScreenPrintf("\nNext step in 1s...\n");
-    for (int t = 0; t < 1000; t += 16) {
-      sceKernelDelayThread(16 * 1000);
-    }
+    pause_and_capture(1000);
+    analyzer_set_prompt(&analyzer, ANALYZER_NO_PROMPT);
   }
 
+  write_analysis(out_fd);
+
   clear_screen();
   psvDebugScreenPrintf("Done!\n\n");
-  psvDebugScreenPrintf("Results written to:\n%s\n\n", OUT_LOG_PATH);
+  psvDebugScreenPrintf("Results and inferred layout written to:\n%s\n\n", OUT_LOG_PATH);
   psvDebugScreenPrintf("Tap the front touchscreen to exit.\n");
   wait_for_tap();
 
-  if (raw_fd >= 0) sceIoClose(raw_fd);
+  vitacontrolSetCapture(0);
   if (out_fd >= 0) sceIoClose(out_fd);
   sceKernelExitProcess(0);
   return 0;